@@ -0,0 +1,90 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdlib.h>
+#include <new>
+
+// Counts heap allocations, for the benchmarks' allocations per op. Replaces
+// the global operator new and delete, so it must be included by exactly one
+// source file of a program (each benchmark and tool is a single file).
+//
+// Every form of new and delete goes through malloc() and free(), so memory
+// from any of them can be released through any other, as it may be: the
+// library's own allocations through ::operator new and tk::aligned_buffer's
+// alike. The count is per thread, so that e.g. the shards of
+// planner_replay each count their own.
+inline long &heapAllocationCount() {
+  static thread_local long count = 0;
+  return count;
+}
+
+// Heap allocations the calling thread has made so far.
+inline long heapAllocations() { return heapAllocationCount(); }
+
+namespace alloc_counter {
+
+inline void *allocate(size_t n) {
+  heapAllocationCount()++;
+  return malloc(n ? n : 1);
+}
+
+}  // namespace alloc_counter
+
+// All of them are kept out of line: inlined into a caller, GCC would see
+// malloc() and free() where the caller uses new and delete and warn
+// (-Wmismatched-new-delete), although they are the replacements below.
+__attribute__((noinline)) void *operator new(size_t n) {
+  void *p = alloc_counter::allocate(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+__attribute__((noinline)) void *operator new[](size_t n) {
+  void *p = alloc_counter::allocate(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+__attribute__((noinline)) void *operator new(size_t n, const std::nothrow_t &) noexcept {
+  return alloc_counter::allocate(n);
+}
+__attribute__((noinline)) void *operator new[](size_t n, const std::nothrow_t &) noexcept {
+  return alloc_counter::allocate(n);
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+#if __cpp_aligned_new
+// Over-aligned types, C++17 on: aligned_alloc() memory is released by free()
+// too.
+__attribute__((noinline)) void *operator new(size_t n, std::align_val_t a) {
+  heapAllocationCount()++;
+  size_t align = static_cast<size_t>(a);
+  void *p = aligned_alloc(align, (n + align - 1) / align * align);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+__attribute__((noinline)) void *operator new[](size_t n, std::align_val_t a) {
+  return operator new(n, a);
+}
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p, std::align_val_t) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+__attribute__((noinline)) void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+#endif
+
+#endif  // ALLOC_COUNTER_H
@@ -0,0 +1,238 @@
+// Benchmark for reading telemetry messages with json::parse() (DOM),
+// json::sax_parse() (events) and decodeTelemetry() (TelemetryFrame).
+//
+//   json_sax_bench [messages]
+//
+// All read the ego car's state, the previous path and the sensor fusion
+// table of simulator-style telemetry messages with 12, 100 and 1000 sensor
+// fusion entries. Also counts heap allocations per message.
+#include <stdlib.h>
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench/BenchTimer.h"
+#include "json.hpp"
+#include "socket_io.h"
+#include "telemetry_frame.h"
+#include "telemetry_samples.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+using json = nlohmann::json;
+
+// The fields main.cpp reads from a telemetry event.
+struct Telemetry {
+  double x, y, s, d, yaw, speed, end_path_s, end_path_d;
+  vector<double> previous_path_x, previous_path_y;
+  vector<array<double, 7> > sensor_fusion;
+
+  void clear() {
+    previous_path_x.clear();
+    previous_path_y.clear();
+    sensor_fusion.clear();
+  }
+  bool operator==(const Telemetry &o) const {
+    return x == o.x && y == o.y && s == o.s && d == o.d && yaw == o.yaw &&
+           speed == o.speed && end_path_s == o.end_path_s &&
+           end_path_d == o.end_path_d && previous_path_x == o.previous_path_x &&
+           previous_path_y == o.previous_path_y && sensor_fusion == o.sensor_fusion;
+  }
+};
+
+static void readDom(const char *first, const char *last, Telemetry *t) {
+  json j = json::parse(first, last);
+  const json &data = j[1];
+  t->clear();
+  t->x = data["x"];
+  t->y = data["y"];
+  t->s = data["s"];
+  t->d = data["d"];
+  t->yaw = data["yaw"];
+  t->speed = data["speed"];
+  t->end_path_s = data["end_path_s"];
+  t->end_path_d = data["end_path_d"];
+  for (const json &v : data["previous_path_x"]) t->previous_path_x.push_back(v);
+  for (const json &v : data["previous_path_y"]) t->previous_path_y.push_back(v);
+  for (const json &car : data["sensor_fusion"]) {
+    array<double, 7> row;
+    for (int k = 0; k < 7; k++) row[k] = car[k];
+    t->sensor_fusion.push_back(row);
+  }
+}
+
+// ["telemetry", {"x": ..., "previous_path_x": [...], "sensor_fusion":
+// [[id, x, y, vx, vy, s, d], ...]}]: scalars sit at depth 2, the path
+// arrays' values at depth 3 and the sensor fusion values at depth 4.
+struct TelemetrySax : json::sax_handler {
+  Telemetry *t;
+  int depth;
+  double *scalar;        // field the next depth 2 number goes to
+  vector<double> *path;  // path array being read
+  int column;            // next sensor fusion column
+
+  explicit TelemetrySax(Telemetry *out)
+      : t(out), depth(0), scalar(0), path(0), column(0) {}
+
+  static bool is(const char *s, size_t n, const char *name) {
+    return strlen(name) == n && memcmp(s, name, n) == 0;
+  }
+
+  bool key(const char *s, size_t n) {
+    scalar = 0;
+    path = 0;
+    if (is(s, n, "x")) scalar = &t->x;
+    else if (is(s, n, "y")) scalar = &t->y;
+    else if (is(s, n, "s")) scalar = &t->s;
+    else if (is(s, n, "d")) scalar = &t->d;
+    else if (is(s, n, "yaw")) scalar = &t->yaw;
+    else if (is(s, n, "speed")) scalar = &t->speed;
+    else if (is(s, n, "end_path_s")) scalar = &t->end_path_s;
+    else if (is(s, n, "end_path_d")) scalar = &t->end_path_d;
+    else if (is(s, n, "previous_path_x")) path = &t->previous_path_x;
+    else if (is(s, n, "previous_path_y")) path = &t->previous_path_y;
+    return true;
+  }
+  bool number(double v) {
+    if (depth == 2 && scalar) {
+      *scalar = v;
+    } else if (depth == 3 && path) {
+      path->push_back(v);
+    } else if (depth == 4 && column < 7) {
+      t->sensor_fusion.back()[column++] = v;
+    }
+    return true;
+  }
+  bool number_float(double v) { return number(v); }
+  bool number_integer(long long v) { return number(double(v)); }
+  bool number_unsigned(unsigned long long v) { return number(double(v)); }
+  bool start_object() {
+    depth++;
+    return true;
+  }
+  bool end_object() {
+    depth--;
+    return true;
+  }
+  bool start_array() {
+    if (++depth == 4) {
+      t->sensor_fusion.push_back(array<double, 7>());
+      column = 0;
+    }
+    return true;
+  }
+  bool end_array() {
+    depth--;
+    return true;
+  }
+};
+
+static void readSax(const char *first, const char *last, Telemetry *t) {
+  t->clear();
+  TelemetrySax sax(t);
+  json::sax_parse(first, last, &sax);
+}
+
+typedef void (*Reader)(const char *, const char *, Telemetry *);
+
+static double readAll(Reader read, const vector<SocketIoFrame> &frames, Telemetry *t) {
+  double sink = 0;
+  for (size_t k = 0; k < frames.size(); k++) {
+    read(frames[k].payload, frames[k].payload + frames[k].payload_length, t);
+    sink += t->s + t->sensor_fusion.size();
+  }
+  return sink;
+}
+
+static double decodeAll(const vector<SocketIoFrame> &frames, TelemetryFrame *t) {
+  double sink = 0;
+  for (size_t k = 0; k < frames.size(); k++) {
+    decodeTelemetry(frames[k].payload, frames[k].payload + frames[k].payload_length, t);
+    sink += t->s + t->sensor_fusion.size();
+  }
+  return sink;
+}
+
+static bool sameAs(const TelemetryFrame &f, const Telemetry &t) {
+  Telemetry u;
+  u.x = f.x, u.y = f.y, u.s = f.s, u.d = f.d, u.yaw = f.yaw, u.speed = f.speed;
+  u.end_path_s = f.end_path_s, u.end_path_d = f.end_path_d;
+  u.previous_path_x.assign(f.previous_path_x.begin(), f.previous_path_x.end());
+  u.previous_path_y.assign(f.previous_path_y.begin(), f.previous_path_y.end());
+  for (int i = 0; i < f.sensor_fusion.size(); i++) {
+    array<double, 7> row;
+    for (int c = 0; c < TrafficSnapshot::kNumColumns; c++) {
+      row[c] = f.sensor_fusion.get(i, TrafficSnapshot::Column(c));
+    }
+    u.sensor_fusion.push_back(row);
+  }
+  return !f.truncated && u == t;
+}
+
+static void bench(int num_cars, int num_messages) {
+  vector<string> messages = telemetrySamples(num_messages, num_cars);
+  vector<SocketIoFrame> frames;
+  size_t bytes = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    SocketIoFrame f = parseSocketIoFrame(messages[k].data(), messages[k].size());
+    if (f.kind == SocketIoFrame::kEvent && f.hasData()) {
+      frames.push_back(f);
+      bytes += f.payload_length;
+    }
+  }
+
+  // Same results, and the reused Telemetry sized for the largest message.
+  int mismatches = 0, frame_mismatches = 0;
+  Telemetry dom_t, sax_t;
+  static TelemetryFrame frame_t;
+  for (size_t k = 0; k < frames.size(); k++) {
+    const char *first = frames[k].payload;
+    const char *last = first + frames[k].payload_length;
+    readDom(first, last, &dom_t);
+    readSax(first, last, &sax_t);
+    if (!(dom_t == sax_t)) mismatches++;
+    if (!decodeTelemetry(first, last, &frame_t) || !sameAs(frame_t, dom_t)) {
+      frame_mismatches++;
+    }
+  }
+
+  double sink = 0;
+  long before = heapAllocations();
+  sink += readAll(readDom, frames, &dom_t);
+  long dom_allocs = heapAllocations() - before;
+  before = heapAllocations();
+  sink += readAll(readSax, frames, &sax_t);
+  long sax_allocs = heapAllocations() - before;
+  before = heapAllocations();
+  sink += decodeAll(frames, &frame_t);
+  long frame_allocs = heapAllocations() - before;
+
+  BenchTimer t_dom, t_sax, t_frame;
+  BENCH(t_dom, 3, 1, sink += readAll(readDom, frames, &dom_t));
+  BENCH(t_sax, 3, 1, sink += readAll(readSax, frames, &sax_t));
+  BENCH(t_frame, 3, 1, sink += decodeAll(frames, &frame_t));
+  escape(&sink);
+
+  double n = frames.size();
+  double us_dom = t_dom.best(Eigen::REAL_TIMER) * 1e6 / n;
+  double us_sax = t_sax.best(Eigen::REAL_TIMER) * 1e6 / n;
+  double us_frame = t_frame.best(Eigen::REAL_TIMER) * 1e6 / n;
+  cout << num_cars << " sensor fusion entries, " << bytes / n << " bytes/message" << endl;
+  cout << "  json::parse + read     " << us_dom << " us/message, "
+       << dom_allocs / n << " allocations/message" << endl;
+  cout << "  json::sax_parse        " << us_sax << " us/message (" << us_dom / us_sax
+       << "x), " << sax_allocs / n << " allocations/message" << endl;
+  cout << "  decodeTelemetry        " << us_frame << " us/message (" << us_dom / us_frame
+       << "x), " << frame_allocs / n << " allocations/message" << endl;
+  cout << "  mismatches             " << mismatches << "/" << frames.size()
+       << " sax, " << frame_mismatches << "/" << frames.size() << " decodeTelemetry" << endl;
+}
+
+int main(int argc, char **argv) {
+  int num_messages = (argc > 1) ? atoi(argv[1]) : 500;
+  bench(12, num_messages);
+  bench(100, num_messages);
+  bench(1000, max(1, num_messages / 10));
+  return 0;
+}
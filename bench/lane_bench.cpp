@@ -0,0 +1,317 @@
+// Benchmark for the planner's lane change decision.
+//
+//   lane_bench
+//
+// Compares main.cpp's old decision, which rescans the whole sensor fusion
+// table for every car too close ahead, against the planner's, which scans
+// the sensor fusion columns the telemetry decoder fills, and against the
+// same decision from LaneOccupancy indices: the TrafficSnapshot's update(),
+// then an index of the cars just ahead of the ego car and, only when one is
+// too close, of the cars beside it, each queried with binary searches. The
+// decoder fills both the old table and the columns, so neither is part of a
+// frame. Whole frames are timed, with and without an added car just ahead
+// of the ego car. Cars are spread uniformly over the highway loop with the
+// ego car in the center lane, for 12 to 5000 cars.
+//
+// Also times the build of an index of all cars and, separately, its
+// queries against brute force scans, which they are checked against; and
+// checks both decisions against the old one in crowded scenes, with
+// several cars too close, from every lane.
+#include <math.h>
+#include <array>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench/BenchTimer.h"
+#include "lane_occupancy.h"
+#include "traffic_snapshot.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+typedef array<double, 7> Row;
+
+static const double kLaneWidth = 4.0;
+static const double kHorizon = 47 * 0.02;
+static const double kMaxS = 6945.554;
+static const double kSafeGap = 30;
+static const double kPassGap = 20;
+static const double kEgoS = 3000;
+
+static vector<Row> makeTraffic(int n) {
+  mt19937 rng(n);
+  uniform_real_distribution<double> s(0, kMaxS), d(0.5, 11.5), v(15, 25);
+  vector<Row> rows(n);
+  for (int i = 0; i < n; i++) {
+    Row r = {{double(i), 0, 0, v(rng), 0, s(rng), d(rng)}};
+    rows[i] = r;
+  }
+  return rows;
+}
+
+static bool inLane(double d, int lane) {
+  return d > lane * kLaneWidth && d < (lane + 1) * kLaneWidth;
+}
+
+// main.cpp's loops before the index, without the logging: the ego lane is
+// fixed before the loop, and the lane change flags stay cleared from one
+// car too close to the next.
+static int oldDecision(const vector<Row> &rows, int lane, double car_s) {
+  bool leftlanechange = true, rightlanechange = true;
+  float ego_lane_center = lane * kLaneWidth + kLaneWidth / 2;
+  int n = rows.size();
+  for (int i = 0; i < n; i++) {
+    float d = rows[i][6];
+    if (!(d < ego_lane_center + kLaneWidth / 2 && d > ego_lane_center - kLaneWidth / 2)) continue;
+    double vx = rows[i][3], vy = rows[i][4];
+    double check_car_s = rows[i][5] + kHorizon * sqrt(vx * vx + vy * vy);
+    if (check_car_s > car_s && check_car_s - car_s < kSafeGap) {
+      if (lane == 1) {
+        for (int j = 0; j < n; j++) {
+          double s = rows[j][5];
+          bool near = s > car_s - kPassGap && s < car_s + kPassGap;
+          if (inLane(float(rows[j][6]), 0) && near) leftlanechange = false;
+          if (inLane(float(rows[j][6]), 2) && near) rightlanechange = false;
+        }
+        if (leftlanechange) lane = 0;
+        if (rightlanechange) lane = 2;
+      }
+      if (lane == 0) {
+        for (int j = 0; j < n; j++) {
+          double s = rows[j][5];
+          if (inLane(float(rows[j][6]), 1) && s > car_s - kPassGap && s < car_s + kPassGap)
+            rightlanechange = false;
+        }
+        if (rightlanechange) lane = 1;
+      }
+      if (lane == 2) {
+        for (int j = 0; j < n; j++) {
+          double s = rows[j][5];
+          if (inLane(float(rows[j][6]), 1) && s > car_s - kPassGap && s < car_s + kPassGap)
+            leftlanechange = false;
+        }
+        if (leftlanechange) lane = 1;
+      }
+    }
+  }
+  return lane;
+}
+
+// The decision's queries: by scanning the columns, as the planner does, or
+// from the indices.
+static int tooCloseCars(const TrafficSnapshot &traffic, const LaneOccupancy *projected,
+                        int lane, double car_s) {
+  if (projected) return projected->countAhead(lane, car_s, kSafeGap);
+  int count = 0, n = traffic.size();
+  double left = lane * kLaneWidth, right = left + kLaneWidth;
+  for (int i = 0; i < n; i++) {
+    double d = traffic.d(i);
+    if (!(d > left && d < right)) continue;
+    double check_car_s = traffic.projectS(i, kHorizon);
+    if (check_car_s > car_s && check_car_s - car_s < kSafeGap) count++;
+  }
+  return count;
+}
+
+// Whether each lane has a car with lo < s < hi.
+static void blockedLanes(const TrafficSnapshot &traffic, const LaneOccupancy *current,
+                         double lo, double hi, bool *blocked) {
+  for (int lane = 0; lane < 3; lane++) {
+    blocked[lane] = current && current->carWithin(lane, lo, hi) >= 0;
+  }
+  if (current) return;
+  for (int i = 0; i < traffic.size(); i++) {
+    double s = traffic.s(i);
+    if (s <= lo || s >= hi) continue;
+    for (int lane = 0; lane < 3; lane++) {
+      if (inLane(traffic.d(i), lane)) blocked[lane] = true;
+    }
+  }
+}
+
+// The decision from the snapshot: by scans of the columns, as the planner
+// makes it, or with `indexed`, from update(), the index of the cars just
+// ahead every frame and the one of the cars beside the ego car only when
+// one is too close. The checks run once per car too close until they
+// change nothing.
+static int newDecision(TrafficSnapshot *traffic, LaneOccupancy *projected,
+                       LaneOccupancy *current, bool indexed, int lane, double car_s) {
+  if (indexed) {
+    traffic->update(kHorizon, kLaneWidth);
+    projected->build(*traffic, 3, LaneOccupancy::kProjectedS, car_s, car_s + kSafeGap);
+  }
+  int too_close_cars = tooCloseCars(*traffic, indexed ? projected : 0, lane, car_s);
+  if (too_close_cars == 0) return lane;
+  double lo = car_s - kPassGap, hi = car_s + kPassGap;
+  if (indexed) current->build(*traffic, 3, LaneOccupancy::kS, lo, hi);
+  bool blocked[3];
+  blockedLanes(*traffic, indexed ? current : 0, lo, hi, blocked);
+  bool left = true, right = true;
+  for (int run = 0; run < too_close_cars; run++) {
+    int last_lane = lane;
+    bool last_left = left, last_right = right;
+    if (lane == 1) {
+      if (blocked[0]) left = false;
+      if (blocked[2]) right = false;
+      if (left) lane = 0;
+      if (right) lane = 2;
+    }
+    if (lane == 0 && blocked[1]) right = false;
+    if (lane == 0 && right) lane = 1;
+    if (lane == 2 && blocked[1]) left = false;
+    if (lane == 2 && left) lane = 1;
+    if (lane == last_lane && left == last_left && right == last_right) break;
+  }
+  return lane;
+}
+
+// What the decoder leaves: the columns, without update().
+static void fill(const vector<Row> &rows, TrafficSnapshot *traffic) {
+  traffic->assign(&rows[0], rows.size());
+}
+
+// The queries the planner makes of a lane, brute force on the rows and on
+// the index of all cars by current s.
+static int scanQueries(const vector<Row> &rows, int lane, double s) {
+  int leader = -1, follower = -1, within = -1;
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (!inLane(rows[i][6], lane)) continue;
+    double cs = rows[i][5];
+    if (cs > s && (leader < 0 || cs < rows[leader][5])) leader = i;
+    if (cs < s && (follower < 0 || cs > rows[follower][5])) follower = i;
+    if (cs > s - kPassGap && cs < s + kPassGap && (within < 0 || cs < rows[within][5]))
+      within = i;
+  }
+  return leader + follower + within;
+}
+
+static int indexQueries(const LaneOccupancy &index, int lane, double s) {
+  return index.leader(lane, s) + index.follower(lane, s) +
+         index.carWithin(lane, s - kPassGap, s + kPassGap);
+}
+
+static int checkQueries(const vector<Row> &rows, const LaneOccupancy &current) {
+  int mismatches = 0;
+  mt19937 rng(1);
+  uniform_real_distribution<double> at(0, kMaxS);
+  for (int q = 0; q < 200; q++) {
+    double s = at(rng);
+    for (int lane = 0; lane < 3; lane++) {
+      int leader = -1, follower = -1, within = -1;
+      for (size_t i = 0; i < rows.size(); i++) {
+        if (!inLane(rows[i][6], lane)) continue;
+        double cs = rows[i][5];
+        if (cs > s && (leader < 0 || cs < rows[leader][5])) leader = i;
+        if (cs < s && (follower < 0 || cs > rows[follower][5])) follower = i;
+        if (cs > s - kPassGap && cs < s + kPassGap &&
+            (within < 0 || cs < rows[within][5]))
+          within = i;
+      }
+      if (current.leader(lane, s) != leader || current.follower(lane, s) != follower ||
+          current.carWithin(lane, s - kPassGap, s + kPassGap) != within)
+        mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+// The background traffic plus 1 to 12 cars around the ego car, with
+// several too close ahead in one lane more often than not, decided from
+// each lane, both by scanning and from the indices. Returns the mismatches
+// out of 3 * scenes.
+static int checkCrowdedScenes(const vector<Row> &background, int scenes,
+                              TrafficSnapshot *traffic, LaneOccupancy *projected,
+                              LaneOccupancy *current) {
+  mt19937 rng(2);
+  uniform_int_distribution<int> count(1, 12), pick_lane(0, 2);
+  uniform_real_distribution<double> ds(-25, 35), offset(0.3, 3.7), v(10, 25);
+  int mismatches = 0;
+  for (int k = 0; k < scenes; k++) {
+    vector<Row> rows = background;
+    int crowded = pick_lane(rng), n = count(rng);
+    for (int i = 0; i < n; i++) {
+      int lane = (i % 2 == 0) ? crowded : pick_lane(rng);
+      Row r = {{double(rows.size()), 0, 0, v(rng), 0, kEgoS + ds(rng),
+                lane * kLaneWidth + offset(rng)}};
+      rows.push_back(r);
+    }
+    fill(rows, traffic);
+    for (int lane = 0; lane < 3; lane++) {
+      int old_lane = oldDecision(rows, lane, kEgoS);
+      if (old_lane != newDecision(traffic, projected, current, false, lane, kEgoS) ||
+          old_lane != newDecision(traffic, projected, current, true, lane, kEgoS))
+        mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+int main() {
+  const int sizes[] = {12, 100, 1000, 5000};
+  for (int n : sizes) {
+    // The random traffic alone, and with a car just ahead of the ego car
+    // in its lane, which makes it consider a lane change.
+    vector<Row> uniform = makeTraffic(n);
+    vector<Row> blocked = uniform;
+    Row blocker = {{double(n), 0, 0, 20, 0, kEgoS + 10, 6}};
+    blocked.push_back(blocker);
+    TrafficSnapshot traffic;
+    LaneOccupancy projected, current, all;
+
+    fill(blocked, &traffic);
+    traffic.update(kHorizon, kLaneWidth);
+    all.build(traffic, 3, LaneOccupancy::kS);
+    int mismatches = checkQueries(blocked, all);
+    int crowded_mismatches = checkCrowdedScenes(uniform, 500, &traffic, &projected, &current);
+    const vector<Row> *cases[] = {&uniform, &blocked};
+    for (const vector<Row> *rows : cases) {
+      fill(*rows, &traffic);
+      int old_lane = oldDecision(*rows, 1, kEgoS);
+      if (old_lane != newDecision(&traffic, &projected, &current, false, 1, kEgoS) ||
+          old_lane != newDecision(&traffic, &projected, &current, true, 1, kEgoS))
+        mismatches++;
+    }
+
+    int reps = max(1, 100000 / n);
+    double sink = 0;
+    fill(blocked, &traffic);
+    traffic.update(kHorizon, kLaneWidth);
+    BenchTimer t_full, t_scan, t_query;
+    BENCH(t_full, 5, reps, all.build(traffic, 3, LaneOccupancy::kS));
+    escape(&all);
+    // 30 positions of each lane per rep
+    const int kQueries = 90;
+    int query_reps = max(1, reps / 30);
+    BENCH(t_scan, 5, query_reps, for (int q = 0; q < kQueries; q++) {
+      sink += scanQueries(blocked, q % 3, kEgoS + q * 10);
+    });
+    BENCH(t_query, 5, reps, for (int q = 0; q < kQueries; q++) {
+      sink += indexQueries(all, q % 3, kEgoS + q * 10);
+    });
+    cout << blocked.size() << " cars" << endl;
+    cout << "  full index build             " << t_full.best(Eigen::REAL_TIMER) * 1e6 / reps
+         << " us" << endl;
+    cout << "  leader+follower+carWithin    scanning "
+         << t_scan.best(Eigen::REAL_TIMER) * 1e9 / (double(query_reps) * kQueries)
+         << " ns, index " << t_query.best(Eigen::REAL_TIMER) * 1e9 / (double(reps) * kQueries)
+         << " ns" << endl;
+    const char *names[] = {"uniform    ", "car ahead  "};
+    for (int c = 0; c < 2; c++) {
+      const vector<Row> &rows = *cases[c];
+      fill(rows, &traffic);
+      BenchTimer t_old, t_columns, t_new;
+      BENCH(t_old, 5, reps, sink += oldDecision(rows, 1, kEgoS));
+      BENCH(t_columns, 5, reps,
+            sink += newDecision(&traffic, &projected, &current, false, 1, kEgoS));
+      BENCH(t_new, 5, reps, sink += newDecision(&traffic, &projected, &current, true, 1, kEgoS));
+      cout << "  " << names[c] << ": rescanning " << t_old.best(Eigen::REAL_TIMER) * 1e6 / reps
+           << " us/frame, planner (scanning columns) " << t_columns.best(Eigen::REAL_TIMER) * 1e6 / reps
+           << " us/frame, LaneOccupancy " << t_new.best(Eigen::REAL_TIMER) * 1e6 / reps
+           << " us/frame" << endl;
+    }
+    escape(&sink);
+    cout << "  mismatches                   " << mismatches << "/602, crowded scenes "
+         << crowded_mismatches << "/1500" << endl;
+  }
+  return 0;
+}
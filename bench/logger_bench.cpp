@@ -0,0 +1,77 @@
+// Benchmark for logging from the planner thread.
+//
+//   logger_bench [events]
+//
+// Compares the cost to the logging thread of one planner message written
+// with cout << ... << endl (to /dev/null, so this is a lower bound for a
+// terminal) against AsyncLogger: enabled, disabled at run time, and removed
+// at compile time. Also reports how many records the ring had to drop.
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include "bench/BenchTimer.h"
+
+// Compile out everything below info, as a release build might.
+#define LOG_COMPILED_LEVEL 1
+#include "async_logger.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+static void viaStream(ostream &out, int n) {
+  for (int i = 0; i < n; i++) {
+    out << "TOO CLOSE: Car ahead @ s = " << 1000.5 + i << ", Ego @ s = " << 990.25 << endl;
+  }
+}
+
+static void viaLogger(AsyncLogger &logger, int n) {
+  for (int i = 0; i < n; i++) {
+    LOG_INFO(logger, "TOO CLOSE: Car ahead @ s = {}, Ego @ s = {}", 1000.5 + i, 990.25);
+  }
+}
+
+static void compiledOut(AsyncLogger &logger, int n) {
+  for (int i = 0; i < n; i++) {
+    LOG_DEBUG(logger, "TOO CLOSE: Car ahead @ s = {}, Ego @ s = {}", 1000.5 + i, 990.25);
+  }
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 1000;
+  ofstream null_stream("/dev/null");
+  // Room for every event of a timed run, so the enabled case measures the
+  // ring write rather than drops.
+  AsyncLogger logger(null_stream, 1 << 16);
+
+  BenchTimer t_stream, t_logger, t_disabled, t_compiled;
+  BENCH(t_stream, 5, 1, viaStream(null_stream, n));
+  BENCH(t_logger, 5, 1, viaLogger(logger, n); logger.flush());
+  logger.setLevel(AsyncLogger::kWarn);
+  BENCH(t_disabled, 5, 1, viaLogger(logger, n));
+  logger.setLevel(AsyncLogger::kDebug);
+  BENCH(t_compiled, 5, 1, compiledOut(logger, n));
+
+  // The flush is timed with the enabled case, so time the logging alone too.
+  BenchTimer t_log_only;
+  t_log_only.reset();
+  for (int k = 0; k < 5; k++) {
+    logger.flush();
+    t_log_only.start();
+    viaLogger(logger, n);
+    t_log_only.stop();
+  }
+  logger.flush();
+
+  cout << n << " messages per run" << endl;
+  cout << "  cout << ... << endl    " << t_stream.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns/message" << endl;
+  cout << "  AsyncLogger            " << t_log_only.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns/message (" << t_logger.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " incl. waiting for the writer)" << endl;
+  cout << "  level disabled         " << t_disabled.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns/message" << endl;
+  cout << "  compiled out           " << t_compiled.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns/message" << endl;
+  cout << "  dropped                " << logger.dropped() << endl;
+  return 0;
+}
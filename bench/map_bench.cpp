@@ -0,0 +1,432 @@
+// Benchmarks for waypoint map lookups.
+//
+//   map_bench [path/to/highway_map.csv]
+//
+// Compares the linear ClosestWaypoint() scan against WaypointIndex on the
+// highway map and on a synthetic 100k-waypoint loop, and the helpers.h
+// getFrenet()/getXY() against the RoadMap versions, including getXY()
+// calls per second with and without the s buckets, and FrenetTracker's
+// warm-started conversions of moving cars (exiting with 1 if they ever
+// differ from RoadMap::getFrenet()), and the piecewise linear map
+// against the spline-fitted one. Also times highway map lookups on tables
+// built at startup, memory mapped and embedded.
+#include <math.h>
+#include <stdio.h>
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench/BenchTimer.h"
+#include "embedded_map_data.h"
+#include "frenet_tracker.h"
+#include "helpers.h"
+#include "map_file.h"
+#include "road_map.h"
+#include "spline_road_map.h"
+#include "synthetic_map.h"
+#include "waypoint_index.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+// Query points scattered up to 12 m off the road around random waypoints.
+static void makeQueries(const MapWaypoints &wp, int count, vector<double> &qx,
+                        vector<double> &qy) {
+  mt19937 rng(42);
+  uniform_int_distribution<int> pick(0, wp.x.size() - 1);
+  uniform_real_distribution<double> off(-12.0, 12.0);
+  for (int k = 0; k < count; k++) {
+    int i = pick(rng);
+    qx.push_back(wp.x[i] + off(rng));
+    qy.push_back(wp.y[i] + off(rng));
+  }
+}
+
+static void benchClosest(const string &name, const MapWaypoints &wp) {
+  const int kQueries = 4096;
+  vector<double> qx, qy;
+  makeQueries(wp, kQueries, qx, qy);
+
+  BenchTimer t_build;
+  WaypointIndex index;
+  BENCH(t_build, 3, 1, index.build(wp.x, wp.y));
+
+  int mismatches = 0;
+  for (int k = 0; k < kQueries; k++) {
+    if (index.closest(qx[k], qy[k]) != ClosestWaypoint(qx[k], qy[k], wp.x, wp.y))
+      mismatches++;
+  }
+
+  int sink = 0;
+  BenchTimer t_scan, t_index, t_seg;
+  // Keep the linear scan's total work roughly constant across map sizes.
+  int scan_queries = max(16, min(kQueries, int(4e7 / wp.x.size())));
+  BENCH(t_scan, 3, 1, for (int k = 0; k < scan_queries; k++)
+                          sink += ClosestWaypoint(qx[k], qy[k], wp.x, wp.y));
+  BENCH(t_index, 5, 16, for (int k = 0; k < kQueries; k++)
+                            sink += index.closest(qx[k], qy[k]));
+  BENCH(t_seg, 5, 16, for (int k = 0; k < kQueries; k++)
+                          sink += index.closestSegment(qx[k], qy[k]));
+  escape(&sink);
+
+  double ns_scan = t_scan.best(Eigen::REAL_TIMER) * 1e9 / scan_queries;
+  double ns_index = t_index.best(Eigen::REAL_TIMER) * 1e9 / (16.0 * kQueries);
+  double ns_seg = t_seg.best(Eigen::REAL_TIMER) * 1e9 / (16.0 * kQueries);
+  cout << name << ": " << wp.x.size() << " waypoints, cell "
+       << index.cellSize() << " m, build "
+       << t_build.best(Eigen::REAL_TIMER) * 1e3 << " ms" << endl;
+  cout << "  ClosestWaypoint scan   " << ns_scan << " ns/query" << endl;
+  cout << "  WaypointIndex closest  " << ns_index << " ns/query ("
+       << ns_scan / ns_index << "x)" << endl;
+  cout << "  WaypointIndex segment  " << ns_seg << " ns/query" << endl;
+  cout << "  mismatches vs scan     " << mismatches << "/" << kQueries << endl;
+}
+
+static void benchFrenet(const string &name, const MapWaypoints &wp, double max_s) {
+  const int kQueries = 4096;
+  RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+
+  // Points on the three lanes, with the road heading as the car's yaw.
+  mt19937 rng(7);
+  uniform_real_distribution<double> pick_s(0.0, wp.s.back());
+  vector<double> qs, qd, qx, qy, qtheta;
+  for (int k = 0; k < kQueries; k++) {
+    double s = pick_s(rng);
+    double d = 2 + 4 * (k % 3);
+    vector<double> xy = getXY(s, d, wp.s, wp.x, wp.y);
+    vector<double> ahead = getXY(s + 1, d, wp.s, wp.x, wp.y);
+    qs.push_back(s);
+    qd.push_back(d);
+    qx.push_back(xy[0]);
+    qy.push_back(xy[1]);
+    qtheta.push_back(atan2(ahead[1] - xy[1], ahead[0] - xy[0]));
+  }
+
+  // Round trip error of s,d -> getXY() -> x,y -> getFrenet() for both
+  // implementations, and how far the two getXY() versions disagree.
+  double err_frenet = 0, err_frenet2 = 0, max_dxy = 0;
+  for (int k = 0; k < kQueries; k++) {
+    vector<double> sd = getFrenet(qx[k], qy[k], qtheta[k], wp.x, wp.y);
+    array<double, 2> sd2 = road_map.getFrenet(qx[k], qy[k]);
+    err_frenet = max(err_frenet, distance(sd[0], sd[1], qs[k], qd[k]));
+    err_frenet2 = max(err_frenet2, distance(sd2[0], sd2[1], qs[k], qd[k]));
+    vector<double> xy = getXY(qs[k], qd[k], wp.s, wp.x, wp.y);
+    array<double, 2> xy2 = road_map.getXY(qs[k], qd[k]);
+    max_dxy = max(max_dxy, distance(xy[0], xy[1], xy2[0], xy2[1]));
+  }
+
+  double sink = 0;
+  BenchTimer t_frenet, t_frenet2, t_xy, t_xy2;
+  int slow_queries = max(16, min(kQueries, int(4e7 / wp.x.size())));
+  BENCH(t_frenet, 3, 1, for (int k = 0; k < slow_queries; k++)
+                            sink += getFrenet(qx[k], qy[k], qtheta[k], wp.x, wp.y)[0]);
+  BENCH(t_frenet2, 5, 16, for (int k = 0; k < kQueries; k++)
+                              sink += road_map.getFrenet(qx[k], qy[k])[0]);
+  BENCH(t_xy, 3, 1, for (int k = 0; k < slow_queries; k++)
+                        sink += getXY(qs[k], qd[k], wp.s, wp.x, wp.y)[0]);
+  BENCH(t_xy2, 5, 16, for (int k = 0; k < kQueries; k++)
+                          sink += road_map.getXY(qs[k], qd[k])[0]);
+  escape(&sink);
+
+  double ns_frenet = t_frenet.best(Eigen::REAL_TIMER) * 1e9 / slow_queries;
+  double ns_frenet2 = t_frenet2.best(Eigen::REAL_TIMER) * 1e9 / (16.0 * kQueries);
+  double ns_xy = t_xy.best(Eigen::REAL_TIMER) * 1e9 / slow_queries;
+  double ns_xy2 = t_xy2.best(Eigen::REAL_TIMER) * 1e9 / (16.0 * kQueries);
+  cout << name << ": Frenet conversions" << endl;
+  cout << "  getFrenet              " << ns_frenet
+       << " ns/call, max round trip error " << err_frenet << " m" << endl;
+  cout << "  RoadMap::getFrenet     " << ns_frenet2 << " ns/call ("
+       << ns_frenet / ns_frenet2 << "x), max round trip error " << err_frenet2
+       << " m" << endl;
+  cout << "  getXY                  " << ns_xy << " ns/call" << endl;
+  cout << "  RoadMap::getXY         " << ns_xy2 << " ns/call (" << ns_xy / ns_xy2
+       << "x), max |dxy| " << max_dxy << " m" << endl;
+}
+
+// The same highway map lookups on tables built at startup, on a memory
+// mapped map file and on the tables compiled into this benchmark from
+// data/highway_map.csv (see embedded_map_header in CMakeLists.txt). All
+// three run the same RoadMap code on run-time sized tables, so only the
+// memory the tables live in differs.
+static void benchTables(const MapWaypoints &wp, double max_s) {
+  const int kQueries = 4096;
+  const string bin_file = "/tmp/map_bench_highway.bin";
+  string error;
+  MapFile map_file;
+  if (!MapFile::write(bin_file, wp, max_s, &error) || !map_file.open(bin_file, &error)) {
+    cerr << error << endl;
+    return;
+  }
+  remove(bin_file.c_str());
+  RoadMap built(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+  RoadMap embedded;
+  MapFile::attachTables(embedded_map::embeddedMapTables(), &embedded);
+  const RoadMap *maps[] = {&built, &map_file.roadMap(), &embedded};
+  const char *names[] = {"built at startup", "MapFile (mmap)", "embedded"};
+
+  mt19937 rng(11);
+  uniform_real_distribution<double> pick_s(0.0, max_s);
+  vector<double> qs(kQueries), qd(kQueries), qx(kQueries), qy(kQueries);
+  for (int k = 0; k < kQueries; k++) {
+    qs[k] = pick_s(rng);
+    qd[k] = 2 + 4 * (k % 3);
+    array<double, 2> xy = built.getXY(qs[k], qd[k]);
+    qx[k] = xy[0];
+    qy[k] = xy[1];
+  }
+
+  cout << "highway_map.csv: lookups by where the tables live" << endl;
+  double sink = 0;
+  for (int m = 0; m < 3; m++) {
+    const RoadMap &road_map = *maps[m];
+    int mismatches = 0;
+    for (int k = 0; k < kQueries; k++) {
+      if (road_map.getXY(qs[k], qd[k]) != built.getXY(qs[k], qd[k]) ||
+          road_map.getFrenet(qx[k], qy[k]) != built.getFrenet(qx[k], qy[k]))
+        mismatches++;
+    }
+    BenchTimer t_frenet, t_xy;
+    BENCH(t_frenet, 5, 16, for (int k = 0; k < kQueries; k++)
+                               sink += road_map.getFrenet(qx[k], qy[k])[0]);
+    BENCH(t_xy, 5, 16, for (int k = 0; k < kQueries; k++)
+                           sink += road_map.getXY(qs[k], qd[k])[0]);
+    double per = 1e9 / (16.0 * kQueries);
+    cout << "  " << left << setw(22) << names[m] << right << " getFrenet "
+         << t_frenet.best(Eigen::REAL_TIMER) * per << " ns/call, getXY "
+         << t_xy.best(Eigen::REAL_TIMER) * per << " ns/call, mismatches "
+         << mismatches << "/" << kQueries << endl;
+  }
+  escape(&sink);
+}
+
+// getXY() throughput: helpers.h linear scan, RoadMap by binary search and
+// RoadMap through the s buckets.
+static void benchGetXY(const string &name, const MapWaypoints &wp, double max_s) {
+  const int kQueries = 4096;
+  RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+
+  mt19937 rng(11);
+  uniform_real_distribution<double> pick_s(0.0, max_s);
+  vector<double> qs, qd;
+  for (int k = 0; k < kQueries; k++) {
+    qs.push_back(pick_s(rng));
+    qd.push_back(2 + 4 * (k % 3));
+  }
+
+  // The bucket lookup must agree with the binary search everywhere, and s
+  // one lap ahead or behind must land on the same point.
+  int mismatches = 0;
+  double max_wrap_err = 0;
+  for (int k = 0; k < kQueries; k++) {
+    if (road_map.segmentAtS(qs[k]) != road_map.segmentAtSBinarySearch(qs[k]))
+      mismatches++;
+    array<double, 2> xy = road_map.getXY(qs[k], qd[k]);
+    array<double, 2> ahead = road_map.getXY(qs[k] + max_s, qd[k]);
+    array<double, 2> behind = road_map.getXY(qs[k] - max_s, qd[k]);
+    max_wrap_err = max(max_wrap_err, distance(xy[0], xy[1], ahead[0], ahead[1]));
+    max_wrap_err = max(max_wrap_err, distance(xy[0], xy[1], behind[0], behind[1]));
+  }
+
+  double sink = 0;
+  BenchTimer t_scan, t_binary, t_bucket;
+  int slow_queries = max(16, min(kQueries, int(4e7 / wp.x.size())));
+  BENCH(t_scan, 3, 1, for (int k = 0; k < slow_queries; k++)
+                          sink += getXY(qs[k], qd[k], wp.s, wp.x, wp.y)[0]);
+  BENCH(t_binary, 5, 16, for (int k = 0; k < kQueries; k++) {
+    double s = road_map.wrapS(qs[k]);
+    sink += road_map.xyOnSegment(road_map.segmentAtSBinarySearch(s), s, qd[k])[0];
+  });
+  BENCH(t_bucket, 5, 16, for (int k = 0; k < kQueries; k++)
+                             sink += road_map.getXY(qs[k], qd[k])[0]);
+  escape(&sink);
+
+  double cps_scan = slow_queries / t_scan.best(Eigen::REAL_TIMER);
+  double cps_binary = 16.0 * kQueries / t_binary.best(Eigen::REAL_TIMER);
+  double cps_bucket = 16.0 * kQueries / t_bucket.best(Eigen::REAL_TIMER);
+  cout << name << ": getXY throughput" << endl;
+  cout << "  getXY linear scan      " << cps_scan * 1e-6 << " M calls/s" << endl;
+  cout << "  RoadMap binary search  " << cps_binary * 1e-6 << " M calls/s" << endl;
+  cout << "  RoadMap s buckets      " << cps_bucket * 1e-6 << " M calls/s ("
+       << cps_bucket / cps_scan << "x scan)" << endl;
+  cout << "  bucket/binary mismatches " << mismatches << "/" << kQueries
+       << ", max wraparound error " << max_wrap_err << " m" << endl;
+}
+
+// Frame-to-frame Frenet conversion of the ego car plus `num_cars` cars
+// driving along the lanes: RoadMap::getFrenet() vs FrenetTracker. Returns
+// the number of conversions in which they disagree, which should be 0.
+static int benchTracker(const string &name, const MapWaypoints &wp, double max_s,
+                        int num_cars) {
+  const int kFrames = 1000;
+  RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+
+  int num_objects = num_cars + 1;
+  vector<double> xs(kFrames * num_objects), ys(kFrames * num_objects);
+  mt19937 rng(3);
+  uniform_real_distribution<double> pick_s(0.0, max_s), pick_v(15.0, 25.0);
+  for (int k = 0; k < num_objects; k++) {
+    double s0 = pick_s(rng), v = pick_v(rng), d = 2 + 4 * (k % 3);
+    for (int f = 0; f < kFrames; f++) {
+      array<double, 2> xy = road_map.getXY(s0 + v * 0.02 * f, d);
+      xs[f * num_objects + k] = xy[0];
+      ys[f * num_objects + k] = xy[1];
+    }
+  }
+
+  vector<double> s_out(num_objects), d_out(num_objects);
+  double max_diff = 0;
+  int disagreements = 0;
+  FrenetTracker check(road_map);
+  vector<FrenetTracker::Hint> check_hints(num_objects);
+  for (int f = 0; f < kFrames; f++) {
+    check.getFrenet(num_objects, &check_hints[0], &xs[f * num_objects],
+                    &ys[f * num_objects], &s_out[0], &d_out[0]);
+    for (int k = 0; k < num_objects; k++) {
+      array<double, 2> sd = road_map.getFrenet(xs[f * num_objects + k],
+                                               ys[f * num_objects + k]);
+      if (sd[0] != s_out[k] || sd[1] != d_out[k]) disagreements++;
+      max_diff = max(max_diff, distance(sd[0], sd[1], s_out[k], d_out[k]));
+    }
+  }
+
+  double sink = 0;
+  BenchTimer t_global, t_tracker;
+  BENCH(t_global, 5, 1, for (int f = 0; f < kFrames; f++) {
+    for (int k = 0; k < num_objects; k++)
+      sink += road_map.getFrenet(xs[f * num_objects + k], ys[f * num_objects + k])[0];
+  });
+  FrenetTracker tracker(road_map);
+  vector<FrenetTracker::Hint> hints(num_objects);
+  BENCH(t_tracker, 5, 1, for (int f = 0; f < kFrames; f++) {
+    tracker.getFrenet(num_objects, &hints[0], &xs[f * num_objects],
+                      &ys[f * num_objects], &s_out[0], &d_out[0]);
+    sink += s_out[0];
+  });
+  escape(&sink);
+
+  double per = 1e9 / (double(kFrames) * num_objects);
+  double ns_global = t_global.best(Eigen::REAL_TIMER) * per;
+  double ns_tracker = t_tracker.best(Eigen::REAL_TIMER) * per;
+  cout << name << ": tracking ego + " << num_cars << " cars over " << kFrames
+       << " frames" << endl;
+  cout << "  RoadMap::getFrenet     " << ns_global << " ns/object" << endl;
+  cout << "  FrenetTracker          " << ns_tracker << " ns/object ("
+       << ns_global / ns_tracker << "x), " << tracker.globalSearches()
+       << " global searches in " << tracker.warmHits() + tracker.globalSearches()
+       << " conversions" << endl;
+  cout << "  disagreements          " << disagreements << "/" << kFrames * num_objects
+       << ", max diff " << max_diff << " m" << endl;
+  return disagreements;
+}
+
+// Largest heading change between points 1 m apart along the center lane,
+// in degrees: the size of the kinks at the waypoints.
+template <class Map>
+static double maxKink(const Map &m) {
+  double worst = 0, prev_heading = 0;
+  array<double, 2> prev = m.getXY(0, 6);
+  for (double s = 1; s < m.maxS(); s += 1) {
+    array<double, 2> xy = m.getXY(s, 6);
+    double heading = atan2(xy[1] - prev[1], xy[0] - prev[0]);
+    if (s > 1) {
+      double turn = fabs(heading - prev_heading);
+      worst = max(worst, min(turn, 2 * pi() - turn));
+    }
+    prev_heading = heading;
+    prev = xy;
+  }
+  return rad2deg(worst);
+}
+
+// Piecewise linear RoadMap vs SplineRoadMap: cost and accuracy.
+static void benchSplineMap(const string &name, const MapWaypoints &wp,
+                           double max_s) {
+  const int kQueries = 4096;
+  RoadMap linear(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+  SplineRoadMap smooth(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+
+  mt19937 rng(5);
+  uniform_real_distribution<double> pick_s(0.0, max_s), pick_d(0.5, 11.5);
+  vector<double> qs, qd, lx, ly, sx, sy;
+  for (int k = 0; k < kQueries; k++) {
+    qs.push_back(pick_s(rng));
+    qd.push_back(pick_d(rng));
+    array<double, 2> a = linear.getXY(qs[k], qd[k]);
+    array<double, 2> b = smooth.getXY(qs[k], qd[k]);
+    lx.push_back(a[0]);
+    ly.push_back(a[1]);
+    sx.push_back(b[0]);
+    sy.push_back(b[1]);
+  }
+
+  // Round trip errors, wrapping the s difference around the seam.
+  double err_linear = 0, err_spline = 0, err_warm = 0;
+  for (int k = 0; k < kQueries; k++) {
+    array<double, 2> a = linear.getFrenet(lx[k], ly[k]);
+    array<double, 2> b = smooth.getFrenet(sx[k], sy[k]);
+    array<double, 2> c = smooth.getFrenet(sx[k], sy[k], qs[k] - 0.4);
+    double ds_a = fabs(a[0] - qs[k]), ds_b = fabs(b[0] - qs[k]), ds_c = fabs(c[0] - qs[k]);
+    err_linear = max(err_linear, max(min(ds_a, max_s - ds_a), fabs(a[1] - qd[k])));
+    err_spline = max(err_spline, max(min(ds_b, max_s - ds_b), fabs(b[1] - qd[k])));
+    err_warm = max(err_warm, max(min(ds_c, max_s - ds_c), fabs(c[1] - qd[k])));
+  }
+
+  double sink = 0;
+  BenchTimer t_lxy, t_sxy, t_lfrenet, t_sfrenet, t_warm;
+  BENCH(t_lxy, 5, 16, for (int k = 0; k < kQueries; k++)
+                          sink += linear.getXY(qs[k], qd[k])[0]);
+  BENCH(t_sxy, 5, 16, for (int k = 0; k < kQueries; k++)
+                          sink += smooth.getXY(qs[k], qd[k])[0]);
+  BENCH(t_lfrenet, 5, 16, for (int k = 0; k < kQueries; k++)
+                              sink += linear.getFrenet(lx[k], ly[k])[0]);
+  BENCH(t_sfrenet, 5, 16, for (int k = 0; k < kQueries; k++)
+                              sink += smooth.getFrenet(sx[k], sy[k])[0]);
+  BENCH(t_warm, 5, 16, for (int k = 0; k < kQueries; k++)
+                           sink += smooth.getFrenet(sx[k], sy[k], qs[k] - 0.4)[0]);
+  escape(&sink);
+
+  double per = 1e9 / (16.0 * kQueries);
+  cout << name << ": linear vs spline road map" << endl;
+  cout << "  RoadMap getXY          " << t_lxy.best(Eigen::REAL_TIMER) * per
+       << " ns/call, max kink " << maxKink(linear) << " deg" << endl;
+  cout << "  SplineRoadMap getXY    " << t_sxy.best(Eigen::REAL_TIMER) * per
+       << " ns/call, max kink " << maxKink(smooth) << " deg" << endl;
+  cout << "  RoadMap getFrenet      " << t_lfrenet.best(Eigen::REAL_TIMER) * per
+       << " ns/call, max round trip error " << err_linear << " m" << endl;
+  cout << "  SplineRoadMap getFrenet " << t_sfrenet.best(Eigen::REAL_TIMER) * per
+       << " ns/call, max round trip error " << err_spline << " m" << endl;
+  cout << "    warm (hint 0.4 m off) " << t_warm.best(Eigen::REAL_TIMER) * per
+       << " ns/call, max round trip error " << err_warm << " m" << endl;
+}
+
+int main(int argc, char **argv) {
+  string map_file = (argc > 1) ? argv[1] : "../data/highway_map.csv";
+  int disagreements = 0;
+
+  MapWaypoints highway;
+  if (readMapCsv(map_file, &highway)) {
+    benchClosest("highway_map.csv", highway);
+    benchFrenet("highway_map.csv", highway, 6945.554);
+    benchGetXY("highway_map.csv", highway, 6945.554);
+    benchTables(highway, 6945.554);
+    disagreements += benchTracker("highway_map.csv", highway, 6945.554, 12);
+    disagreements += benchTracker("highway_map.csv", highway, 6945.554, 200);
+    benchSplineMap("highway_map.csv", highway, 6945.554);
+  } else {
+    cerr << "Could not read " << map_file << ", skipping" << endl;
+  }
+  MapWaypoints synthetic = syntheticLoop(100000, 30.0);
+  benchClosest("synthetic", synthetic);
+  double synthetic_max_s = loopMaxS(synthetic);
+  benchFrenet("synthetic", synthetic, synthetic_max_s);
+  benchGetXY("synthetic", synthetic, synthetic_max_s);
+  disagreements += benchTracker("synthetic", synthetic, synthetic_max_s, 200);
+  if (disagreements > 0) {
+    cerr << "FrenetTracker disagreed with RoadMap::getFrenet() " << disagreements
+         << " times" << endl;
+    return 1;
+  }
+  return 0;
+}
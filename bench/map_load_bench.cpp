@@ -0,0 +1,170 @@
+// Startup time benchmark for the road map.
+//
+//   map_load_bench [waypoints] [work dir]
+//
+// Writes a synthetic loop (1M waypoints by default) as CSV and as a binary
+// map to the work dir (default /tmp), then compares parsing the CSV and
+// building the RoadMap tables against memory mapping the binary map. Also
+// drives 100 km along a tiled version of the map, reading tiles on demand.
+#include <stdio.h>
+#include <stdlib.h>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench/BenchTimer.h"
+#include "map_file.h"
+#include "road_map.h"
+#include "synthetic_map.h"
+#include "tiled_road_map.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+static long fileSize(const string &path) {
+  ifstream in(path.c_str(), ios::binary | ios::ate);
+  return in ? long(in.tellg()) : -1;
+}
+
+static double lookups(const RoadMap &road_map, const vector<double> &qs) {
+  double sink = 0;
+  for (size_t k = 0; k < qs.size(); k++) {
+    array<double, 2> xy = road_map.getXY(qs[k], 6);
+    sink += road_map.getFrenet(xy[0], xy[1])[0];
+  }
+  return sink;
+}
+
+// What path_planning does at startup with a CSV map.
+static double startFromCsv(const string &csv_file, double max_s,
+                           const vector<double> &qs) {
+  MapWaypoints wp;
+  readMapCsv(csv_file, &wp);
+  RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+  return lookups(road_map, qs);
+}
+
+// ... and with a binary map.
+static double startFromMapFile(const string &bin_file, const vector<double> &qs) {
+  MapFile map_file;
+  map_file.open(bin_file);
+  return lookups(map_file.roadMap(), qs);
+}
+
+// One 20 ms frame per 0.5 m for `km` kilometers, placing the trajectory
+// anchors 30/60/90 m ahead like path_planning does. Returns the number of
+// anchors that differ from the RoadMap's. The frames run back to back here,
+// so the prefetch thread gets microseconds instead of seconds to read the
+// next tile, and lookups often still wait for it.
+static int drive(TiledRoadMap *tiled, const RoadMap &road_map, double km,
+                 double *sink) {
+  int mismatches = 0;
+  for (double s = 0; s < km * 1000; s += 0.5) {
+    tiled->prefetch(s);
+    for (int k = 1; k <= 3; k++) {
+      array<double, 2> xy = tiled->getXY(s + 30 * k, 6);
+      if (xy != road_map.getXY(s + 30 * k, 6)) mismatches++;
+      *sink += xy[0];
+    }
+  }
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+  string dir = (argc > 2) ? argv[2] : "/tmp";
+  string csv_file = dir + "/map_load_bench.csv";
+  string bin_file = dir + "/map_load_bench.bin";
+  string tile_file = dir + "/map_load_bench.tiles";
+
+  MapWaypoints synthetic = syntheticLoop(n, 30.0);
+  double max_s = loopMaxS(synthetic);
+  {
+    ofstream out(csv_file.c_str());
+    out << setprecision(17);
+    for (size_t i = 0; i < synthetic.size(); i++) {
+      out << synthetic.x[i] << " " << synthetic.y[i] << " " << synthetic.s[i]
+          << " " << synthetic.dx[i] << " " << synthetic.dy[i] << "\n";
+    }
+  }
+  BenchTimer t_write;
+  string error;
+  bool written = true;
+  BENCH(t_write, 1, 1, written = MapFile::write(bin_file, synthetic, max_s, &error));
+  if (!written) {
+    cerr << error << endl;
+    return 1;
+  }
+
+  // A few lookups after loading, so the binary map's timing includes
+  // faulting in the pages they touch.
+  mt19937 rng(1);
+  uniform_real_distribution<double> pick_s(0.0, max_s);
+  const int kQueries = 1000;
+  vector<double> qs(kQueries);
+  for (int k = 0; k < kQueries; k++) qs[k] = pick_s(rng);
+
+  double sink = 0;
+  BenchTimer t_csv, t_bin;
+  BENCH(t_csv, 3, 1, sink += startFromCsv(csv_file, max_s, qs));
+  BENCH(t_bin, 3, 1, sink += startFromMapFile(bin_file, qs));
+  escape(&sink);
+
+  // Both maps must give identical answers.
+  MapFile map_file;
+  if (!map_file.open(bin_file, &error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  RoadMap built(synthetic.x, synthetic.y, synthetic.s, synthetic.dx,
+                synthetic.dy, max_s);
+  int mismatches = 0;
+  for (int k = 0; k < kQueries; k++) {
+    array<double, 2> a = built.getXY(qs[k], 6);
+    array<double, 2> b = map_file.roadMap().getXY(qs[k], 6);
+    if (a != b || built.getFrenet(a[0], a[1]) != map_file.roadMap().getFrenet(b[0], b[1]))
+      mismatches++;
+  }
+
+  // Tiled map: getXY() while driving, and its answers against RoadMap's.
+  if (!TiledRoadMap::write(tile_file, synthetic, max_s, 1000.0, true, &error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  BenchTimer t_tiled_open, t_drive;
+  TiledRoadMap tiled;
+  BENCH(t_tiled_open, 1, 1, tiled.open(tile_file, &error));
+  const double kDriveKm = 100;
+  int tiled_mismatches = 0;
+  BENCH(t_drive, 1, 1, tiled_mismatches = drive(&tiled, built, kDriveKm, &sink));
+  escape(&sink);
+  double anchors = kDriveKm * 1000 / 0.5 * 3;
+
+  double ms_csv = t_csv.best(Eigen::REAL_TIMER) * 1e3;
+  double ms_bin = t_bin.best(Eigen::REAL_TIMER) * 1e3;
+  cout << n << " waypoints" << endl;
+  cout << "  CSV " << fileSize(csv_file) / 1e6 << " MB, binary map "
+       << fileSize(bin_file) / 1e6 << " MB, written in "
+       << t_write.best(Eigen::REAL_TIMER) * 1e3 << " ms" << endl;
+  cout << "  CSV parse + RoadMap build  " << ms_csv << " ms" << endl;
+  cout << "  MapFile::open (mmap)       " << ms_bin << " ms (" << ms_csv / ms_bin
+       << "x)" << endl;
+  cout << "  mismatches                 " << mismatches << "/" << kQueries << endl;
+  cout << "  tiled map, " << tiled.numTiles() << " tiles of "
+       << tiled.tileLength() << " m, " << fileSize(tile_file) / 1e6 << " MB" << endl;
+  cout << "    open                     " << t_tiled_open.best(Eigen::REAL_TIMER) * 1e3
+       << " ms" << endl;
+  cout << "    getXY() driving " << kDriveKm << " km   "
+       << t_drive.best(Eigen::REAL_TIMER) * 1e9 / anchors << " ns/call, "
+       << tiled.tileLoads() << " tiles read (" << tiled.blockingLoads()
+       << " waited for), " << tiled.cachedTiles() << " cached" << endl;
+  cout << "    mismatches               " << tiled_mismatches << "/" << anchors << endl;
+
+  remove(csv_file.c_str());
+  remove(bin_file.c_str());
+  remove(tile_file.c_str());
+  return 0;
+}
@@ -0,0 +1,77 @@
+// Benchmark for the planner's latency metrics.
+//
+//   metrics_bench [samples]
+//
+// Times LatencyHistogram::record() alone and PlannerMetrics::lap(), the
+// clock read plus record() that every stage of a message pays, without and
+// with the SpanTracer span lap() also records, and the /metrics and /trace
+// pages. Also checks the histogram's quantiles against exact ones
+// on log-normally distributed latencies.
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench/BenchTimer.h"
+#include "planner_metrics.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+static void recordAll(LatencyHistogram *h, const vector<uint64_t> &values) {
+  for (size_t i = 0; i < values.size(); i++) h->record(values[i]);
+}
+
+static uint64_t lapAll(PlannerMetrics *m, int n) {
+  uint64_t t = m->now();
+  for (int i = 0; i < n; i++) t = m->lap(PlannerMetrics::Stage(i % 7), t);
+  return t;
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 100000;
+  mt19937 rng(7);
+  lognormal_distribution<double> latency(10, 1.5);  // median about 22 us
+  vector<uint64_t> values(n);
+  for (int i = 0; i < n; i++) values[i] = uint64_t(latency(rng));
+
+  // Quantiles within a bucket's width of the exact ones.
+  LatencyHistogram h;
+  recordAll(&h, values);
+  vector<uint64_t> sorted = values;
+  sort(sorted.begin(), sorted.end());
+  double worst = 0;
+  const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  for (double q : quantiles) {
+    double exact = sorted[size_t(q * (n - 1))];
+    worst = max(worst, fabs(h.quantile(q) - exact) / exact);
+  }
+
+  static PlannerMetrics metrics;
+  double sink = 0;
+  BenchTimer t_record, t_lap, t_traced, t_page, t_trace;
+  BENCH(t_record, 5, 1, recordAll(&h, values));
+  BENCH(t_lap, 5, 1, sink += lapAll(&metrics, n));
+  SpanTracer::instance().registerThread("bench");
+  BENCH(t_traced, 5, 1, sink += lapAll(&metrics, n));
+  string page, trace;
+  BENCH(t_page, 5, 10, page = metrics.prometheus());
+  BENCH(t_trace, 5, 1, trace = SpanTracer::instance().chromeTrace(1));
+  escape(&sink);
+
+  cout << n << " samples" << endl;
+  cout << "  record()               " << t_record.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns" << endl;
+  cout << "  lap()                  " << t_lap.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns (clock read + record)" << endl;
+  cout << "  lap() with tracing     " << t_traced.best(Eigen::REAL_TIMER) * 1e9 / n
+       << " ns" << endl;
+  cout << "  prometheus()           " << t_page.best(Eigen::REAL_TIMER) * 1e6 / 10
+       << " us, " << page.size() << " bytes" << endl;
+  cout << "  chromeTrace(1)         " << t_trace.best(Eigen::REAL_TIMER) * 1e3
+       << " ms, " << trace.size() << " bytes" << endl;
+  cout << "  worst quantile error   " << worst * 100 << "% (bucket width "
+       << 100.0 / LatencyHistogram::kSubBuckets << "%)" << endl;
+  return 0;
+}
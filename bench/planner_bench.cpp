@@ -0,0 +1,314 @@
+// Microbenchmarks for the planner's kernels.
+//
+//   planner_bench [--filter substring] [--seed N] [path/to/highway_map.csv]
+//
+// Times the helpers.h map functions (ClosestWaypoint, NextWaypoint,
+// getFrenet, getXY), tk::spline (set_points, operator()) and the
+// band_matrix solve behind it, tk::fixed_spline<5> on the path anchors,
+// json::parse and dump on telemetry messages, and the full per-frame step,
+// Planner::handle() on a telemetry message.
+// Map kernels run on the highway map and on synthetic loops of 1k, 10k and
+// 100k waypoints, message kernels with 10 to 10000 other cars from
+// TrafficGenerator (seeded with --seed), and the frame step on every
+// combination.
+//
+// Prints one row per benchmark and parameter set, always in the same order,
+// with the best time per op over several tries and the heap allocations
+// per op. Rows are keyed by their first three columns, so the output of two
+// builds can be compared with e.g. `join`.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench/BenchTimer.h"
+#include "helpers.h"
+#include "json.hpp"
+#include "map_file.h"
+#include "planner.h"
+#include "road_map.h"
+#include "spline.h"
+#include "synthetic_map.h"
+#include "traffic_generator.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+using json = nlohmann::json;
+
+static const int kTries = 5;
+static const double kTrySeconds = 0.02;
+static const double kHighwayMaxS = 6945.554;
+static const int kQueries = 64;  // a power of two
+static const int kCarCounts[] = {10, 100, 1000, 10000};
+
+static const char *filter = 0;
+static uint32_t seed = 1;
+
+// Times op() and prints its row. The repetitions per try are doubled until
+// a try takes kTrySeconds, so that fast and slow kernels are timed alike.
+template <class Op>
+static void run(const char *name, const string &map, const string &cars, Op op) {
+  if (filter && !strstr(name, filter)) return;
+  BenchTimer t;
+  int reps = 1;
+  for (;;) {
+    BENCH(t, 1, reps, op());
+    if (t.best() >= kTrySeconds || reps >= (1 << 24)) break;
+    reps *= 2;
+  }
+  long before = heapAllocations();
+  BENCH(t, kTries, reps, op());
+  double allocs = double(heapAllocations() - before) / (kTries * reps);
+  printf("%-28s %-9s %-6s %12.1f %10.2f\n", name, map.c_str(), cars.c_str(),
+         t.best() * 1e9 / reps, allocs);
+  fflush(stdout);
+}
+
+struct Map {
+  MapWaypoints wp;
+  double max_s;
+  RoadMap road;
+
+  Map(const MapWaypoints &w, double s)
+      : wp(w), max_s(s), road(w.x, w.y, w.s, w.dx, w.dy, s) {}
+};
+
+// Points on the road, up to one lane off it on either side, with the
+// heading of the road there.
+struct Query {
+  double x, y, theta, s, d;
+};
+
+static vector<Query> makeQueries(const Map &map) {
+  mt19937 rng(int(map.wp.size()));
+  uniform_real_distribution<double> s(0, map.max_s), d(-4, 16);
+  vector<Query> queries;
+  for (int i = 0; i < kQueries; i++) {
+    Query q;
+    q.s = s(rng);
+    q.d = d(rng);
+    array<double, 2> a = map.road.getXY(q.s, q.d), b = map.road.getXY(q.s + 1, q.d);
+    q.x = a[0];
+    q.y = a[1];
+    q.theta = atan2(b[1] - a[1], b[0] - a[0]);
+    queries.push_back(q);
+  }
+  return queries;
+}
+
+// A simulator telemetry message: the car cruising in the center lane at s
+// with 47 points of its previous path left, among `cars` other cars from
+// TrafficGenerator spread over the loop.
+static string makeTelemetry(const Map &map, double s, int cars) {
+  TrafficGenerator::Options options;
+  options.seed = seed;
+  options.cars = cars;
+  TrafficGenerator traffic(&map.road, options);
+  traffic.reset(s);
+  string message;
+  telemetryMessage(EgoState::cruising(map.road, s, 6, 49.5, 47), traffic.rows(), &message);
+  return message;
+}
+
+// The two frames Planner::handle is timed on, with the car as in
+// makeTelemetry() at s, which must be well away from the ends of the loop.
+// In `clear` no car is within 100 m of it, so the planner speeds up. In
+// `close` one car per lane is 15 m ahead: too close in the car's lane and
+// blocking both lane changes, so the planner slows down and stays in the
+// center lane. Taking turns keeps the planner at speed, on the full
+// planning step, with the lane change decision run every other frame.
+static void makeFrames(const Map &map, double s, int cars, string *clear, string *close) {
+  TrafficGenerator::Options options;
+  options.seed = seed;
+  options.cars = cars;
+  TrafficGenerator traffic(&map.road, options);
+  traffic.reset(s);
+  vector<TrafficGenerator::Row> rows;
+  for (const TrafficGenerator::Row &row : traffic.rows()) {
+    if (fabs(row[5] - s) > 100) rows.push_back(row);
+  }
+  EgoState ego = EgoState::cruising(map.road, s, 6, 49.5, 47);
+  telemetryMessage(ego, rows, clear);
+  for (int lane = 0; lane < 3; lane++) {
+    double d = 2 + 4 * lane;
+    array<double, 2> p = map.road.getXY(s + 15, d), q = map.road.getXY(s + 16, d);
+    TrafficGenerator::Row row = {
+        {double(cars + lane), p[0], p[1], 20 * (q[0] - p[0]), 20 * (q[1] - p[1]), s + 15, d}};
+    rows.push_back(row);
+  }
+  telemetryMessage(ego, rows, close);
+}
+
+static void benchMap(const Map &map) {
+  const vector<double> &mx = map.wp.x, &my = map.wp.y, &ms = map.wp.s;
+  vector<Query> queries = makeQueries(map);
+  string size = to_string(map.wp.size());
+  double sink = 0;
+  int k = 0;
+
+  run("ClosestWaypoint", size, "-", [&] {
+    const Query &q = queries[k++ & (kQueries - 1)];
+    sink += ClosestWaypoint(q.x, q.y, mx, my);
+  });
+  run("NextWaypoint", size, "-", [&] {
+    const Query &q = queries[k++ & (kQueries - 1)];
+    sink += NextWaypoint(q.x, q.y, q.theta, mx, my);
+  });
+  run("getFrenet", size, "-", [&] {
+    const Query &q = queries[k++ & (kQueries - 1)];
+    sink += getFrenet(q.x, q.y, q.theta, mx, my)[0];
+  });
+  run("getXY", size, "-", [&] {
+    const Query &q = queries[k++ & (kQueries - 1)];
+    sink += getXY(fmod(q.s, ms.back()), q.d, ms, mx, my)[0];
+  });
+
+  // x as a function of s through every waypoint, as SplineRoadMap fits it
+  tk::spline fit;
+  run("spline::set_points", size, "-", [&] {
+    fit.set_points(ms, mx);
+    sink += fit(0);
+  });
+  run("spline::operator()", size, "-", [&] {
+    sink += fit(fmod(queries[k++ & (kQueries - 1)].s, ms.back()));
+  });
+
+  // The tridiagonal system of that fit, decomposed once
+  int n = map.wp.size();
+  tk::band_matrix A(n, 1, 1);
+  vector<double> rhs(n);
+  for (int i = 0; i < n; i++) {
+    A(i, i) = 4;
+    if (i > 0) A(i, i - 1) = 1;
+    if (i < n - 1) A(i, i + 1) = 1;
+    rhs[i] = sin(i);
+  }
+  A.lu_decompose();
+  run("band_matrix::lu_solve", size, "-", [&] { sink += A.lu_solve(rhs, true)[n / 2]; });
+  escape(&sink);
+}
+
+// The five anchors main.cpp fits its path through, in car coordinates,
+// for a lane change to the left.
+static void benchAnchorSpline() {
+  vector<double> x = {-0.88, 0, 30, 60, 90}, y = {0.01, 0, 2, 4, 4};
+  double sink = 0;
+  int k = 0;
+  tk::spline fit;
+  run("spline::set_points", "anchors", "-", [&] {
+    fit.set_points(x, y);
+    sink += fit(0);
+  });
+  run("spline::operator()", "anchors", "-", [&] { sink += fit(0.6 * (k++ & 127)); });
+  tk::fixed_spline<5> fixed;
+  run("fixed_spline<5>::set_points", "anchors", "-", [&] {
+    fixed.set_points(x, y);
+    sink += fixed(0);
+  });
+  run("fixed_spline<5>::operator()", "anchors", "-", [&] { sink += fixed(0.6 * (k++ & 127)); });
+
+  tk::band_matrix A(5, 1, 1);
+  vector<double> rhs = {0, 0.1, 0.2, 0.1, 0};
+  for (int i = 0; i < 5; i++) {
+    A(i, i) = 4;
+    if (i > 0) A(i, i - 1) = 1;
+    if (i < 4) A(i, i + 1) = 1;
+  }
+  A.lu_decompose();
+  run("band_matrix::lu_solve", "anchors", "-", [&] { sink += A.lu_solve(rhs, true)[2]; });
+  escape(&sink);
+}
+
+static void benchJson(const Map &highway) {
+  double sink = 0;
+  for (int cars : kCarCounts) {
+    string message = makeTelemetry(highway, 3000, cars);
+    string n = to_string(cars);
+    json j = json::parse(message.begin() + 2, message.end());
+    run("json::parse", "-", n, [&] {
+      json parsed = json::parse(message.begin() + 2, message.end());
+      sink += parsed.size();
+    });
+    run("json::dump", "-", n, [&] { sink += j.dump().size(); });
+  }
+
+  // The reply to a frame: 50 path points
+  json reply;
+  vector<double> next_x, next_y;
+  for (int i = 0; i < 50; i++) {
+    next_x.push_back(909.48 + 0.44 * i);
+    next_y.push_back(1128.67 + 0.01 * i * i);
+  }
+  reply["next_x"] = next_x;
+  reply["next_y"] = next_y;
+  run("json::dump", "-", "reply", [&] { sink += reply.dump().size(); });
+  escape(&sink);
+}
+
+static void benchPlanner(const Map &map) {
+  PlannerMap planner_map;
+  planner_map.build(map.wp, map.max_s, false);
+  AsyncLogger logger;
+  logger.setLevel(AsyncLogger::kOff);
+  PlannerMetrics metrics;
+  string size = to_string(map.wp.size()), reply;
+  double sink = 0;
+  for (int cars : kCarCounts) {
+    string frames[2];
+    makeFrames(map, 0.4 * map.max_s, cars, &frames[0], &frames[1]);
+    // Up to speed before timing, as in a running session
+    Planner planner(&planner_map, &logger, &metrics, TelemetryFrame::kMaxSyntheticCars);
+    for (int i = 0; i < 250; i++) {
+      planner.handle(frames[0].data(), frames[0].size(), metrics.now(), &reply);
+    }
+    uint64_t fits = metrics.stage(PlannerMetrics::kSplineFit).count();
+    uint64_t calls = 0;
+    run("Planner::handle", size, to_string(cars), [&] {
+      const string &message = frames[calls++ & 1];
+      planner.handle(message.data(), message.size(), metrics.now(), &reply);
+      sink += reply.size();
+    });
+    // Every frame must have been planned in full, at speed and in lane
+    if (metrics.stage(PlannerMetrics::kSplineFit).count() - fits != calls ||
+        !(planner.refVel() > 0) || planner.lane() != 1) {
+      fprintf(stderr, "Planner::handle with %d cars did not plan every frame in full\n", cars);
+      exit(1);
+    }
+  }
+  escape(&sink);
+}
+
+int main(int argc, char **argv) {
+  string map_file = "../data/highway_map.csv";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], 0, 10);
+    } else {
+      map_file = argv[i];
+    }
+  }
+  MapWaypoints highway_wp;
+  if (!readMapCsv(map_file, &highway_wp)) {
+    fprintf(stderr, "Failed to read %s\n", map_file.c_str());
+    return 1;
+  }
+  vector<Map> maps;
+  maps.push_back(Map(highway_wp, kHighwayMaxS));
+  for (int n : {1000, 10000, 100000}) {
+    MapWaypoints wp = syntheticLoop(n, 30.0);
+    maps.push_back(Map(wp, loopMaxS(wp)));
+  }
+
+  printf("%-28s %-9s %-6s %12s %10s\n", "benchmark", "map", "cars", "ns/op", "allocs/op");
+  for (const Map &map : maps) benchMap(map);
+  benchAnchorSpline();
+  benchJson(maps[0]);
+  for (const Map &map : maps) benchPlanner(map);
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Benchmark for handling the simulator's websocket messages.
+//
+//   socket_io_bench [frames]
+//
+// Compares the old hasData() path (copying the buffer into a std::string,
+// then taking a substr for json::parse) against parseSocketIoFrame(), which
+// classifies the message and hands the JSON span to the parser in place.
+// Also counts the heap allocations made by each step.
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench/BenchTimer.h"
+#include "json.hpp"
+#include "socket_io.h"
+#include "telemetry_samples.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+using json = nlohmann::json;
+
+// main.cpp's hasData() before SocketIoFrame, applied to string(data) as it
+// was called.
+static string hasData(string s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.find_first_of("}");
+  if (found_null != string::npos) {
+    return "";
+  } else if (b1 != string::npos && b2 != string::npos) {
+    return s.substr(b1, b2 - b1 + 2);
+  }
+  return "";
+}
+
+static double oldFraming(const vector<string> &messages) {
+  double sink = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    const char *data = messages[k].data();
+    size_t length = messages[k].size();
+    if (length > 2 && data[0] == '4' && data[1] == '2') {
+      string s = hasData(data);
+      sink += s.size();
+    }
+  }
+  return sink;
+}
+
+static double newFraming(const vector<string> &messages) {
+  double sink = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    SocketIoFrame f = parseSocketIoFrame(messages[k].data(), messages[k].size());
+    if (f.kind == SocketIoFrame::kEvent && f.hasData()) sink += f.payload_length;
+  }
+  return sink;
+}
+
+static double oldParse(const vector<string> &messages) {
+  double sink = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    const char *data = messages[k].data();
+    size_t length = messages[k].size();
+    if (length > 2 && data[0] == '4' && data[1] == '2') {
+      string s = hasData(data);
+      if (s != "") sink += json::parse(s)[1]["s"].get<double>();
+    }
+  }
+  return sink;
+}
+
+static double newParse(const vector<string> &messages) {
+  double sink = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    SocketIoFrame f = parseSocketIoFrame(messages[k].data(), messages[k].size());
+    if (f.kind == SocketIoFrame::kEvent && f.hasData()) {
+      sink += json::parse(f.payload, f.payload + f.payload_length)[1]["s"].get<double>();
+    }
+  }
+  return sink;
+}
+
+int main(int argc, char **argv) {
+  int frames = (argc > 1) ? atoi(argv[1]) : 2000;
+  vector<string> messages = telemetrySamples(frames);
+  size_t bytes = 0;
+  for (size_t k = 0; k < messages.size(); k++) bytes += messages[k].size();
+
+  // Both must find the same events and the same JSON.
+  int mismatches = 0;
+  for (size_t k = 0; k < messages.size(); k++) {
+    string old_json = (messages[k].size() > 2 && messages[k].compare(0, 2, "42") == 0)
+                          ? hasData(messages[k])
+                          : "";
+    SocketIoFrame f = parseSocketIoFrame(messages[k].data(), messages[k].size());
+    string new_json = (f.kind == SocketIoFrame::kEvent && f.hasData())
+                          ? string(f.payload, f.payload_length)
+                          : "";
+    if (old_json != new_json) mismatches++;
+  }
+
+  double sink = 0;
+  long before = heapAllocations();
+  sink += oldFraming(messages);
+  long old_allocs = heapAllocations() - before;
+  before = heapAllocations();
+  sink += newFraming(messages);
+  long new_allocs = heapAllocations() - before;
+
+  BenchTimer t_old, t_new, t_old_parse, t_new_parse;
+  const int kReps = 10;
+  BENCH(t_old, 5, kReps, sink += oldFraming(messages));
+  BENCH(t_new, 5, kReps, sink += newFraming(messages));
+  BENCH(t_old_parse, 3, 1, sink += oldParse(messages));
+  BENCH(t_new_parse, 3, 1, sink += newParse(messages));
+  escape(&sink);
+
+  double n = messages.size();
+  cout << messages.size() << " messages, " << bytes / n << " bytes on average"
+       << endl;
+  cout << "  hasData()              " << t_old.best(Eigen::REAL_TIMER) * 1e9 / (kReps * n)
+       << " ns/message, " << old_allocs / n << " allocations/message" << endl;
+  cout << "  parseSocketIoFrame()   " << t_new.best(Eigen::REAL_TIMER) * 1e9 / (kReps * n)
+       << " ns/message, " << new_allocs / n << " allocations/message" << endl;
+  cout << "  hasData() + parse      " << t_old_parse.best(Eigen::REAL_TIMER) * 1e6 / n
+       << " us/message" << endl;
+  cout << "  frame + parse in place " << t_new_parse.best(Eigen::REAL_TIMER) * 1e6 / n
+       << " us/message" << endl;
+  cout << "  mismatches             " << mismatches << "/" << messages.size() << endl;
+  return 0;
+}
@@ -0,0 +1,572 @@
+// Benchmark for fitting and evaluating the planner's path spline.
+//
+//   spline_bench [fits]
+//
+// Fits the five anchor points of a path, as main.cpp does every frame,
+// with tk::spline and with tk::fixed_spline<5>, and compares time and heap
+// allocations per fit and per evaluation. The anchor sets are random lane
+// keeping and lane changing paths; every value of fixed_spline is checked
+// to be bit for bit the same as spline's, with the default natural
+// boundary and with clamped first derivatives.
+//
+// Also solves the tridiagonal systems of splines with 10 to 1M knots with
+// the old tk::band_matrix, which kept each band in its own vector, and the
+// current one, which keeps them all in one buffer and solves in place.
+//
+// Then evaluates a path spline and a 181-knot spline at 50 to 5000 sorted
+// points with operator(), eval_batch() and eval_batch_sorted(), checking
+// that the batches give operator()'s values bit for bit. Last, gets value,
+// slope and curvature at the same points with operator() and deriv(1) and
+// deriv(2), with eval_derivs() and with eval_derivs_batch_sorted().
+//
+// Finally fits and evaluates 8, 16 and 64 candidate paths at once with
+// tk::spline_batch<5>, one SIMD lane per candidate, against fitting each
+// with fixed_spline<5> and with spline, and checks that every candidate's
+// values are bit for bit fixed_spline's.
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench/BenchTimer.h"
+#include "spline.h"
+#include "spline_batch.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+static const int kAnchors = 5;
+static const int kPathPoints = 50;
+
+struct Anchors {
+  vector<double> x, y;
+};
+
+// In car coordinates: the end of the previous path just behind the origin,
+// then three points 30 m apart, up to one lane to either side.
+static vector<Anchors> makeAnchors(int n) {
+  mt19937 rng(n);
+  uniform_real_distribution<double> back(0.3, 1.0), along(-2, 2), lateral(-4.5, 4.5);
+  vector<Anchors> sets(n);
+  for (int i = 0; i < n; i++) {
+    Anchors &a = sets[i];
+    double target = lateral(rng);
+    a.x = {-back(rng), 0, 30 + along(rng), 60 + along(rng), 90 + along(rng)};
+    a.y = {0.01 * along(rng), 0, 0.5 * target, target, target};
+  }
+  return sets;
+}
+
+// Where main.cpp evaluates the path, plus both extrapolations.
+static double evalX(int k) { return -3 + 98.0 * k / (kPathPoints - 1); }
+
+static double fitSpline(const vector<Anchors> &sets, tk::spline *s) {
+  double sum = 0;
+  for (const Anchors &a : sets) {
+    s->set_points(a.x, a.y);
+    sum += (*s)(30.0);
+  }
+  return sum;
+}
+
+static double fitFixed(const vector<Anchors> &sets, tk::fixed_spline<kAnchors> *s) {
+  double sum = 0;
+  for (const Anchors &a : sets) {
+    s->set_points(a.x, a.y);
+    sum += (*s)(30.0);
+  }
+  return sum;
+}
+
+template <class Spline>
+static double evalPath(const Spline &s) {
+  double sum = 0;
+  for (int k = 0; k < kPathPoints; k++) sum += s(evalX(k));
+  return sum;
+}
+
+// tk::band_matrix before it kept its bands in one buffer, reduced to what
+// a tridiagonal solve uses, with its bounds checks.
+class OldBandMatrix {
+ public:
+  OldBandMatrix(int dim, int n_u, int n_l) : upper_(n_u + 1), lower_(n_l + 1) {
+    for (vector<double> &band : upper_) band.resize(dim);
+    for (vector<double> &band : lower_) band.resize(dim);
+  }
+  int dim() const { return upper_[0].size(); }
+  int numUpper() const { return upper_.size() - 1; }
+  int numLower() const { return lower_.size() - 1; }
+  double &operator()(int i, int j) {
+    int k = j - i;
+    assert(i >= 0 && i < dim() && j >= 0 && j < dim());
+    assert(-numLower() <= k && k <= numUpper());
+    return k >= 0 ? upper_[k][i] : lower_[-k][i];
+  }
+  double operator()(int i, int j) const {
+    int k = j - i;
+    assert(i >= 0 && i < dim() && j >= 0 && j < dim());
+    assert(-numLower() <= k && k <= numUpper());
+    return k >= 0 ? upper_[k][i] : lower_[-k][i];
+  }
+  double &savedDiag(int i) {
+    assert(i >= 0 && i < dim());
+    return lower_[0][i];
+  }
+  double savedDiag(int i) const {
+    assert(i >= 0 && i < dim());
+    return lower_[0][i];
+  }
+
+  void luDecompose() {
+    OldBandMatrix &A = *this;
+    int n = dim();
+    for (int i = 0; i < n; i++) {
+      savedDiag(i) = 1.0 / A(i, i);
+      int j_min = max(0, i - numLower()), j_max = min(n - 1, i + numUpper());
+      for (int j = j_min; j <= j_max; j++) A(i, j) *= savedDiag(i);
+      A(i, i) = 1.0;
+    }
+    for (int k = 0; k < n; k++) {
+      int i_max = min(n - 1, k + numLower());
+      for (int i = k + 1; i <= i_max; i++) {
+        double x = -A(i, k) / A(k, k);
+        A(i, k) = -x;
+        int j_max = min(n - 1, k + numUpper());
+        for (int j = k + 1; j <= j_max; j++) A(i, j) = A(i, j) + x * A(k, j);
+      }
+    }
+  }
+  vector<double> lSolve(const vector<double> &b) const {
+    const OldBandMatrix &A = *this;
+    vector<double> x(dim());
+    for (int i = 0; i < dim(); i++) {
+      double sum = 0;
+      for (int j = max(0, i - numLower()); j < i; j++) sum += A(i, j) * x[j];
+      x[i] = (b[i] * savedDiag(i)) - sum;
+    }
+    return x;
+  }
+  vector<double> rSolve(const vector<double> &b) const {
+    const OldBandMatrix &A = *this;
+    vector<double> x(dim());
+    for (int i = dim() - 1; i >= 0; i--) {
+      double sum = 0;
+      int j_stop = min(dim() - 1, i + numUpper());
+      for (int j = i + 1; j <= j_stop; j++) sum += A(i, j) * x[j];
+      x[i] = (b[i] - sum) / A(i, i);
+    }
+    return x;
+  }
+  vector<double> luSolve(const vector<double> &b) {
+    luDecompose();
+    vector<double> y = lSolve(b);
+    return rSolve(y);
+  }
+
+ private:
+  vector<vector<double> > upper_, lower_;
+};
+
+// The system spline::set_points() solves for knots spaced 20 to 40 m
+// apart: natural boundaries, curvature jumps on the right.
+struct Tridiagonal {
+  vector<double> lower, diag, upper, rhs;
+
+  explicit Tridiagonal(int n) : lower(n), diag(n), upper(n), rhs(n) {
+    mt19937 rng(n);
+    uniform_real_distribution<double> spacing(20, 40), slope(-0.1, 0.1);
+    vector<double> h(n - 1);
+    for (double &v : h) v = spacing(rng);
+    for (int i = 1; i < n - 1; i++) {
+      lower[i] = 1.0 / 3.0 * h[i - 1];
+      diag[i] = 2.0 / 3.0 * (h[i - 1] + h[i]);
+      upper[i] = 1.0 / 3.0 * h[i];
+      rhs[i] = slope(rng);
+    }
+    diag[0] = diag[n - 1] = 2.0;
+  }
+  int size() const { return diag.size(); }
+
+  template <class Matrix>
+  void fill(Matrix *A) const {
+    int n = size();
+    for (int i = 0; i < n; i++) {
+      if (i > 0) (*A)(i, i - 1) = lower[i];
+      (*A)(i, i) = diag[i];
+      if (i < n - 1) (*A)(i, i + 1) = upper[i];
+    }
+  }
+};
+
+static double solveOld(const Tridiagonal &system, vector<double> *b) {
+  int n = system.size();
+  OldBandMatrix A(n, 1, 1);
+  system.fill(&A);
+  *b = A.luSolve(system.rhs);
+  return (*b)[n / 2];
+}
+
+static double solveFlat(const Tridiagonal &system, tk::band_matrix *A, vector<double> *b) {
+  int n = system.size();
+  A->resize(n, 1, 1);
+  system.fill(A);
+  b->assign(system.rhs.begin(), system.rhs.end());
+  A->lu_solve(b->data());
+  return (*b)[n / 2];
+}
+
+static double substituteOld(const OldBandMatrix &lu, const vector<double> &rhs,
+                            vector<double> *b) {
+  *b = lu.rSolve(lu.lSolve(rhs));
+  return (*b)[b->size() / 2];
+}
+
+static double substituteFlat(const tk::band_matrix &lu, const vector<double> &rhs,
+                             vector<double> *b) {
+  b->assign(rhs.begin(), rhs.end());
+  lu.l_solve(b->data());
+  lu.r_solve(b->data());
+  return (*b)[b->size() / 2];
+}
+
+static bool sameBits(double a, double b) { return memcmp(&a, &b, sizeof(a)) == 0; }
+
+// Values of both splines that differ in any bit, over all sets.
+static int mismatches(const vector<Anchors> &sets, bool clamped) {
+  int count = 0;
+  for (const Anchors &a : sets) {
+    tk::spline s;
+    tk::fixed_spline<kAnchors> f;
+    if (clamped) {
+      s.set_boundary(tk::spline::first_deriv, 0.02, tk::spline::first_deriv, -0.01);
+      f.set_boundary(tk::spline::first_deriv, 0.02, tk::spline::first_deriv, -0.01);
+    }
+    s.set_points(a.x, a.y);
+    f.set_points(a.x, a.y);
+    for (int k = 0; k < kPathPoints; k++) {
+      if (!sameBits(s(evalX(k)), f(evalX(k)))) count++;
+    }
+    for (int i = 0; i < kAnchors; i++) {
+      if (!sameBits(s(a.x[i]), f(a.x[i]))) count++;
+    }
+  }
+  return count;
+}
+
+static double evalEach(const tk::spline &s, const vector<double> &xs, vector<double> *ys) {
+  for (size_t k = 0; k < xs.size(); k++) (*ys)[k] = s(xs[k]);
+  return (*ys)[xs.size() / 2];
+}
+
+static double evalBatch(const tk::spline &s, const vector<double> &xs, vector<double> *ys) {
+  s.eval_batch(xs.data(), ys->data(), xs.size());
+  return (*ys)[xs.size() / 2];
+}
+
+static double evalSorted(const tk::spline &s, const vector<double> &xs, vector<double> *ys) {
+  s.eval_batch_sorted(xs.data(), ys->data(), xs.size());
+  return (*ys)[xs.size() / 2];
+}
+
+static int differing(const vector<double> &a, const vector<double> &b) {
+  int count = 0;
+  for (size_t i = 0; i < a.size(); i++) count += !sameBits(a[i], b[i]);
+  return count;
+}
+
+// Batch evaluation of s at n evenly spaced points over [lo, hi].
+static void benchBatch(const char *name, const tk::spline &s, double lo, double hi) {
+  const int tries = 5;
+  BenchTimer t;
+  double sink = 0;
+  for (int n = 50; n <= 5000; n *= 10) {
+    vector<double> xs(n), each(n), batch(n), sorted(n);
+    for (int k = 0; k < n; k++) xs[k] = lo + (hi - lo) * k / (n - 1);
+    int reps = max(1, 200000 / n);
+    BENCH(t, tries, reps, sink += evalEach(s, xs, &each));
+    double ns_each = t.best() * 1e9 / (reps * double(n));
+    BENCH(t, tries, reps, sink += evalBatch(s, xs, &batch));
+    double ns_batch = t.best() * 1e9 / (reps * double(n));
+    BENCH(t, tries, reps, sink += evalSorted(s, xs, &sorted));
+    double ns_sorted = t.best() * 1e9 / (reps * double(n));
+    cout << "  " << name << ", " << n << " points" << endl;
+    cout << "    operator()                 " << ns_each << " ns/point" << endl;
+    cout << "    eval_batch()               " << ns_batch << " ns/point" << endl;
+    cout << "    eval_batch_sorted()        " << ns_sorted << " ns/point" << endl;
+    cout << "    mismatches                 "
+         << differing(each, batch) + differing(each, sorted) << "/" << 2 * n << endl;
+  }
+  escape(&sink);
+}
+
+struct Derivs {
+  vector<double> f, df, ddf;
+  explicit Derivs(int n) : f(n), df(n), ddf(n) {}
+};
+
+static double derivsSeparately(const tk::spline &s, const vector<double> &xs, Derivs *d) {
+  for (size_t k = 0; k < xs.size(); k++) {
+    d->f[k] = s(xs[k]);
+    d->df[k] = s.deriv(1, xs[k]);
+    d->ddf[k] = s.deriv(2, xs[k]);
+  }
+  return d->ddf[xs.size() / 2];
+}
+
+static double derivsFused(const tk::spline &s, const vector<double> &xs, Derivs *d) {
+  for (size_t k = 0; k < xs.size(); k++) s.eval_derivs(xs[k], d->f[k], d->df[k], d->ddf[k]);
+  return d->ddf[xs.size() / 2];
+}
+
+static double derivsSorted(const tk::spline &s, const vector<double> &xs, Derivs *d) {
+  s.eval_derivs_batch_sorted(xs.data(), d->f.data(), d->df.data(), d->ddf.data(), xs.size());
+  return d->ddf[xs.size() / 2];
+}
+
+static int differing(const Derivs &a, const Derivs &b) {
+  return differing(a.f, b.f) + differing(a.df, b.df) + differing(a.ddf, b.ddf);
+}
+
+// Value, slope and curvature of s at n evenly spaced points over [lo, hi].
+static void benchDerivs(const char *name, const tk::spline &s, double lo, double hi) {
+  const int tries = 5;
+  BenchTimer t;
+  double sink = 0;
+  for (int n = 50; n <= 5000; n *= 10) {
+    vector<double> xs(n);
+    for (int k = 0; k < n; k++) xs[k] = lo + (hi - lo) * k / (n - 1);
+    Derivs separate(n), fused(n), sorted(n);
+    int reps = max(1, 200000 / n);
+    BENCH(t, tries, reps, sink += derivsSeparately(s, xs, &separate));
+    double ns_separate = t.best() * 1e9 / (reps * double(n));
+    BENCH(t, tries, reps, sink += derivsFused(s, xs, &fused));
+    double ns_fused = t.best() * 1e9 / (reps * double(n));
+    BENCH(t, tries, reps, sink += derivsSorted(s, xs, &sorted));
+    double ns_sorted = t.best() * 1e9 / (reps * double(n));
+    cout << "  " << name << ", " << n << " points" << endl;
+    cout << "    operator(), deriv(1, 2)    " << ns_separate << " ns/point" << endl;
+    cout << "    eval_derivs()              " << ns_fused << " ns/point" << endl;
+    cout << "    eval_derivs_batch_sorted() " << ns_sorted << " ns/point" << endl;
+    cout << "    mismatches                 "
+         << differing(separate, fused) + differing(separate, sorted) << "/" << 6 * n << endl;
+  }
+  escape(&sink);
+}
+
+// K candidate paths: their anchors as spline_batch takes them, point i of
+// candidate j at [i * K + j], and one x per candidate for each path point.
+struct Candidates {
+  int k;
+  vector<Anchors> sets;
+  vector<double> x, y, xs;
+  Candidates(const vector<Anchors> &all, int count)
+      : k(count), x(kAnchors * count), y(kAnchors * count), xs(count) {
+    for (int j = 0; j < k; j++) {
+      sets.push_back(all[j % all.size()]);
+      for (int i = 0; i < kAnchors; i++) {
+        x[i * k + j] = sets[j].x[i];
+        y[i * k + j] = sets[j].y[i];
+      }
+    }
+  }
+};
+
+static double fitEachSpline(const Candidates &c, tk::spline *s) {
+  double sum = 0;
+  for (const Anchors &a : c.sets) {
+    s->set_points(a.x, a.y);
+    sum += evalPath(*s);
+  }
+  return sum;
+}
+
+static double fitEachFixed(const Candidates &c, tk::fixed_spline<kAnchors> *s) {
+  double sum = 0;
+  for (const Anchors &a : c.sets) {
+    s->set_points(a.x, a.y);
+    sum += evalPath(*s);
+  }
+  return sum;
+}
+
+static double fitBatch(Candidates *c, tk::spline_batch<kAnchors> *b, vector<double> *ys) {
+  double sum = 0;
+  b->set_points(c->x.data(), c->y.data(), c->k);
+  for (int p = 0; p < kPathPoints; p++) {
+    fill(c->xs.begin(), c->xs.end(), evalX(p));
+    b->eval(c->xs.data(), ys->data());
+    sum += (*ys)[0];
+  }
+  return sum;
+}
+
+// Values of the batch, by eval() and operator(), that differ in any bit
+// from fixed_spline's.
+static int mismatches(Candidates *c, bool clamped) {
+  tk::spline_batch<kAnchors> b;
+  tk::fixed_spline<kAnchors> f;
+  if (clamped) {
+    b.set_boundary(tk::spline::first_deriv, 0.02, tk::spline::first_deriv, -0.01);
+    f.set_boundary(tk::spline::first_deriv, 0.02, tk::spline::first_deriv, -0.01);
+  }
+  b.set_points(c->x.data(), c->y.data(), c->k);
+  vector<double> ys(c->k);
+  int count = 0;
+  for (int p = 0; p < kPathPoints + kAnchors; p++) {
+    for (int j = 0; j < c->k; j++) {
+      c->xs[j] = p < kPathPoints ? evalX(p) : c->sets[j].x[p - kPathPoints];
+    }
+    b.eval(c->xs.data(), ys.data());
+    for (int j = 0; j < c->k; j++) {
+      f.set_points(c->sets[j].x, c->sets[j].y);
+      double expected = f(c->xs[j]);
+      count += !sameBits(ys[j], expected) + !sameBits(b(j, c->xs[j]), expected);
+    }
+  }
+  return count;
+}
+
+// Fitting k candidate paths and evaluating each at the 50 path points.
+static void benchCandidates(const vector<Anchors> &all, int k) {
+  const int tries = 5;
+  const int reps = max(1, 20000 / k);
+  BenchTimer t;
+  double sink = 0;
+  Candidates c(all, k);
+
+  tk::spline s;
+  long before = heapAllocations();
+  BENCH(t, tries, reps, sink += fitEachSpline(c, &s));
+  double ns_spline = t.best() * 1e9 / (reps * double(k));
+  double allocs_spline = double(heapAllocations() - before) / (tries * reps * double(k));
+  tk::fixed_spline<kAnchors> f;
+  BENCH(t, tries, reps, sink += fitEachFixed(c, &f));
+  double ns_fixed = t.best() * 1e9 / (reps * double(k));
+  // The batch keeps its rows from the first fit on
+  tk::spline_batch<kAnchors> b;
+  vector<double> ys(k);
+  sink += fitBatch(&c, &b, &ys);
+  before = heapAllocations();
+  BENCH(t, tries, reps, sink += fitBatch(&c, &b, &ys));
+  double ns_batch = t.best() * 1e9 / (reps * double(k));
+  double allocs_batch = double(heapAllocations() - before) / (tries * reps * double(k));
+
+  // The fits alone
+  BENCH(t, tries, reps, for (const Anchors &a : c.sets) f.set_points(a.x, a.y));
+  double ns_fixed_fit = t.best() * 1e9 / (reps * double(k));
+  BENCH(t, tries, reps, b.set_points(c.x.data(), c.y.data(), k));
+  double ns_batch_fit = t.best() * 1e9 / (reps * double(k));
+  sink += f(30.0) + b(0, 30.0);
+
+  int total = 2 * 2 * k * (kPathPoints + kAnchors);
+  cout << "  " << k << " candidates, fit and " << kPathPoints << " points each" << endl;
+  cout << "    spline                     " << ns_spline << " ns/candidate, " << allocs_spline
+       << " allocations/candidate" << endl;
+  cout << "    fixed_spline<5>            " << ns_fixed << " ns/candidate, fit "
+       << ns_fixed_fit << " ns" << endl;
+  cout << "    spline_batch<5>            " << ns_batch << " ns/candidate, fit "
+       << ns_batch_fit << " ns, " << allocs_batch << " allocations/candidate" << endl;
+  cout << "    mismatches                 " << mismatches(&c, false) + mismatches(&c, true)
+       << "/" << total << endl;
+  escape(&sink);
+}
+
+int main(int argc, char **argv) {
+  int fits = (argc > 1) ? atoi(argv[1]) : 1000;
+  const int tries = 5;
+  vector<Anchors> sets = makeAnchors(fits);
+  double sink = 0;
+  BenchTimer t;
+
+  cout << "5-point path spline, " << fits << " anchor sets" << endl;
+  {
+    tk::spline s;
+    long before = heapAllocations();
+    BENCH(t, tries, 1, sink += fitSpline(sets, &s));
+    double allocs = double(heapAllocations() - before) / (tries * fits);
+    cout << "  spline::set_points           " << t.best() * 1e9 / fits << " ns/fit, "
+         << allocs << " allocations/fit" << endl;
+    BENCH(t, tries, fits, sink += evalPath(s));
+    cout << "  spline::operator()           " << t.best() * 1e9 / (fits * kPathPoints)
+         << " ns/point" << endl;
+  }
+  {
+    tk::fixed_spline<kAnchors> f;
+    long before = heapAllocations();
+    BENCH(t, tries, 1, sink += fitFixed(sets, &f));
+    double allocs = double(heapAllocations() - before) / (tries * fits);
+    cout << "  fixed_spline<5>::set_points  " << t.best() * 1e9 / fits << " ns/fit, "
+         << allocs << " allocations/fit" << endl;
+    BENCH(t, tries, fits, sink += evalPath(f));
+    cout << "  fixed_spline<5>::operator()  " << t.best() * 1e9 / (fits * kPathPoints)
+         << " ns/point" << endl;
+  }
+  int total = fits * (kPathPoints + kAnchors);
+  cout << "  mismatches, natural          " << mismatches(sets, false) << "/" << total << endl;
+  cout << "  mismatches, clamped          " << mismatches(sets, true) << "/" << total << endl;
+
+  cout << "tridiagonal band_matrix solve (decompose and solve)" << endl;
+  for (int n = 10; n <= 1000000; n *= 10) {
+    Tridiagonal system(n);
+    vector<double> b_old, b_flat;
+    int reps = max(1, 1000000 / n);
+    long before = heapAllocations();
+    BENCH(t, tries, reps, sink += solveOld(system, &b_old));
+    double ns_old = t.best() * 1e9 / (reps * double(n));
+    double allocs_old = double(heapAllocations() - before) / (tries * reps);
+    // The matrix and the solution are reused, as a caller refitting would
+    tk::band_matrix A;
+    solveFlat(system, &A, &b_flat);
+    before = heapAllocations();
+    BENCH(t, tries, reps, sink += solveFlat(system, &A, &b_flat));
+    double ns_flat = t.best() * 1e9 / (reps * double(n));
+    double allocs_flat = double(heapAllocations() - before) / (tries * reps);
+    int differ = 0;
+    for (int i = 0; i < n; i++) differ += !sameBits(b_old[i], b_flat[i]);
+
+    // Substitution only, on the decomposed matrices
+    OldBandMatrix old_lu(n, 1, 1);
+    system.fill(&old_lu);
+    old_lu.luDecompose();
+    BENCH(t, tries, reps, sink += substituteOld(old_lu, system.rhs, &b_old));
+    double ns_old_subst = t.best() * 1e9 / (reps * double(n));
+    BENCH(t, tries, reps, sink += substituteFlat(A, system.rhs, &b_flat));
+    double ns_flat_subst = t.best() * 1e9 / (reps * double(n));
+
+    cout << "  " << n << " unknowns" << endl;
+    cout << "    vector per band            " << ns_old << " ns/unknown, " << allocs_old
+         << " allocations/solve, substitution " << ns_old_subst << " ns/unknown" << endl;
+    cout << "    one buffer, in place       " << ns_flat << " ns/unknown, " << allocs_flat
+         << " allocations/solve, substitution " << ns_flat_subst << " ns/unknown" << endl;
+    cout << "    mismatches                 " << differ << "/" << n << endl;
+  }
+
+  cout << "batch evaluation" << endl;
+  {
+    tk::spline path;
+    path.set_points(sets[0].x, sets[0].y);
+    benchBatch("path spline, 5 knots", path, -3, 95);
+    // A closed curve's x over its length, like SplineRoadMap's
+    vector<double> knots_s, knots_x;
+    for (int i = 0; i < 181; i++) {
+      knots_s.push_back(38.4 * i);
+      knots_x.push_back(1000 * cos(2 * M_PI * i / 181) + 30 * sin(14 * M_PI * i / 181));
+    }
+    tk::spline curve;
+    curve.set_points(knots_s, knots_x);
+    benchBatch("181 knots", curve, 0, knots_s.back());
+
+    cout << "value, slope and curvature" << endl;
+    benchDerivs("path spline, 5 knots", path, -3, 95);
+    benchDerivs("181 knots", curve, 0, knots_s.back());
+  }
+
+  cout << "candidate paths, one SIMD lane each" << endl;
+  for (int k : {8, 16, 64}) benchCandidates(sets, k);
+  escape(&sink);
+  return 0;
+}
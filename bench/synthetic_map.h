@@ -0,0 +1,24 @@
+#ifndef SYNTHETIC_MAP_H
+#define SYNTHETIC_MAP_H
+
+#include <math.h>
+#include "helpers.h"
+#include "map_file.h"
+
+// Closed loop of n waypoints about `spacing` meters apart, with a few
+// lobes so that it is not a plain circle. dx/dy point away from the center.
+inline MapWaypoints syntheticLoop(int n, double spacing) {
+  MapWaypoints wp;
+  double radius = n * spacing / (2 * pi());
+  double s = 0;
+  for (int i = 0; i < n; i++) {
+    double t = 2 * pi() * i / n;
+    double r = radius * (1.0 + 0.05 * sin(7 * t));
+    double x = r * cos(t), y = r * sin(t);
+    if (i > 0) s += distance(wp.x[i - 1], wp.y[i - 1], x, y);
+    wp.push_back(x, y, s, cos(t), sin(t));
+  }
+  return wp;
+}
+
+#endif  // SYNTHETIC_MAP_H
@@ -0,0 +1,56 @@
+#ifndef TELEMETRY_SAMPLES_H
+#define TELEMETRY_SAMPLES_H
+
+#include <math.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Websocket messages shaped like the ones the simulator sends: telemetry
+// events for the ego car driving along a gently curving road with
+// `num_cars` sensor fusion cars, a previous path of up to 50 points, and
+// every 50th frame an Engine.IO ping or a manual mode (null data) event.
+inline std::vector<std::string> telemetrySamples(int frames, int num_cars = 12) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> jitter(-0.5, 0.5);
+  std::vector<std::string> messages;
+  double s = 124.8336;
+  for (int f = 0; f < frames; f++) {
+    if (f % 50 == 25) {
+      messages.push_back("2");
+      continue;
+    }
+    if (f % 50 == 49) {
+      messages.push_back("42[\"telemetry\",null]");
+      continue;
+    }
+    s += 0.44;
+    double x = 909.48 + s, y = 1128.67 + 20 * sin(s / 500);
+    std::ostringstream m;
+    m.precision(10);
+    m << "42[\"telemetry\",{\"x\":" << x << ",\"y\":" << y << ",\"yaw\":"
+      << 0.04 * cos(s / 500) * 57.29578 << ",\"speed\":49.47 ,\"s\":" << s
+      << ",\"d\":" << 6 + 0.1 * jitter(rng);
+    int prev = 47 + f % 3;
+    m << ",\"previous_path_x\":[";
+    for (int k = 0; k < prev; k++) m << (k ? "," : "") << x + 0.44 * (k + 3);
+    m << "],\"previous_path_y\":[";
+    for (int k = 0; k < prev; k++) {
+      m << (k ? "," : "") << 1128.67 + 20 * sin((s + 0.44 * (k + 3)) / 500);
+    }
+    m << "],\"end_path_s\":" << s + 0.44 * (prev + 3) << ",\"end_path_d\":6";
+    m << ",\"sensor_fusion\":[";
+    for (int c = 0; c < num_cars; c++) {
+      double cs = s - 150 + 300.0 * c / num_cars + jitter(rng);
+      m << (c ? "," : "") << "[" << c << "," << 909.48 + cs << ","
+        << 1128.67 + 20 * sin(cs / 500) << "," << 20 + jitter(rng) << ","
+        << jitter(rng) << "," << cs << "," << 2 + 4 * (c % 3) + jitter(rng) << "]";
+    }
+    m << "]}]";
+    messages.push_back(m.str());
+  }
+  return messages;
+}
+
+#endif  // TELEMETRY_SAMPLES_H
@@ -0,0 +1,143 @@
+// Benchmark for the per-vehicle sensor fusion pass.
+//
+//   traffic_bench
+//
+// Compares computing speed, lane and projected s per vehicle the way
+// main.cpp did, row by row from the sensor fusion table, against
+// TrafficSnapshot's column-wise Eigen pass, for 12 to 10000 vehicles. The
+// telemetry decoder fills the columns directly, so update() is the whole
+// cost of the column pass; the filled rows are also timed, storing the
+// decoded values into a row table and then passing over it vs. storing them
+// into the columns with addCar() and set() and calling update(). Eigen
+// vectorizes more of update() when built for newer instruction sets, e.g.
+// with -march=native.
+#include <math.h>
+#include <array>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bench/BenchTimer.h"
+#include "traffic_snapshot.h"
+
+using namespace std;
+using Eigen::BenchTimer;
+
+typedef array<double, 7> Row;
+
+static const double kLaneWidth = 4.0;
+static const double kHorizon = 47 * 0.02;
+
+static vector<Row> makeTraffic(int n) {
+  mt19937 rng(n);
+  uniform_real_distribution<double> s(0, 6945.554), d(0.5, 11.5), v(-25, 25);
+  vector<Row> rows(n);
+  for (int i = 0; i < n; i++) {
+    Row r = {{double(i), 0, 0, v(rng), v(rng), s(rng), d(rng)}};
+    rows[i] = r;
+  }
+  return rows;
+}
+
+// Row by row, as the planner loop did.
+static double rowPass(const vector<Row> &rows, vector<double> *speed,
+                      vector<int> *lane, vector<double> *projected_s) {
+  for (size_t i = 0; i < rows.size(); i++) {
+    double vx = rows[i][3], vy = rows[i][4];
+    (*speed)[i] = sqrt(vx * vx + vy * vy);
+    (*projected_s)[i] = rows[i][5] + kHorizon * (*speed)[i];
+    double d = rows[i][6];
+    int l = -1;
+    for (int k = 0; k < 3; k++) {
+      double center = k * kLaneWidth + kLaneWidth / 2;
+      if (d < center + kLaneWidth / 2 && d > center - kLaneWidth / 2) l = k;
+    }
+    (*lane)[i] = l;
+  }
+  return (*projected_s)[0];
+}
+
+// What the decoder does with the values of every car, then the row pass.
+static double filledRowPass(const vector<Row> &values, vector<Row> *table,
+                            vector<double> *speed, vector<int> *lane,
+                            vector<double> *projected_s) {
+  table->clear();
+  for (size_t i = 0; i < values.size(); i++) {
+    table->push_back(Row());
+    for (int c = 0; c < 7; c++) table->back()[c] = values[i][c];
+  }
+  return rowPass(*table, speed, lane, projected_s);
+}
+
+// The same into the columns, then update().
+static double filledUpdatePass(const vector<Row> &values, TrafficSnapshot *traffic) {
+  traffic->clear();
+  for (size_t i = 0; i < values.size(); i++) {
+    traffic->addCar();
+    for (int c = 0; c < TrafficSnapshot::kNumColumns; c++) {
+      traffic->set(traffic->size() - 1, TrafficSnapshot::Column(c), values[i][c]);
+    }
+  }
+  traffic->update(kHorizon, kLaneWidth);
+  return traffic->projectedS(0);
+}
+
+static double updatePass(TrafficSnapshot *traffic) {
+  traffic->update(kHorizon, kLaneWidth);
+  return traffic->projectedS(0);
+}
+
+static double snapshotPass(const vector<Row> &rows, TrafficSnapshot *traffic) {
+  traffic->assign(&rows[0], rows.size());
+  traffic->update(kHorizon, kLaneWidth);
+  return traffic->projectedS(0);
+}
+
+int main() {
+  const int sizes[] = {12, 100, 1000, 10000};
+  for (int n : sizes) {
+    vector<Row> rows = makeTraffic(n);
+    vector<double> speed(n), projected_s(n);
+    vector<int> lane(n);
+    vector<Row> table;
+    table.reserve(n);
+    TrafficSnapshot traffic(n);
+
+    rowPass(rows, &speed, &lane, &projected_s);
+    filledUpdatePass(rows, &traffic);
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+      if (fabs(traffic.speed(i) - speed[i]) > 1e-12 || traffic.lane(i) != lane[i] ||
+          fabs(traffic.projectedS(i) - projected_s[i]) > 1e-9)
+        mismatches++;
+    }
+
+    int reps = max(1, 200000 / n);
+    double sink = 0;
+    BenchTimer t_rows, t_update, t_filled_rows, t_filled_update, t_assign;
+    BENCH(t_rows, 5, reps, sink += rowPass(rows, &speed, &lane, &projected_s));
+    BENCH(t_update, 5, reps, sink += updatePass(&traffic));
+    BENCH(t_filled_rows, 5, reps,
+          sink += filledRowPass(rows, &table, &speed, &lane, &projected_s));
+    BENCH(t_filled_update, 5, reps, sink += filledUpdatePass(rows, &traffic));
+    BENCH(t_assign, 5, reps, sink += snapshotPass(rows, &traffic));
+    escape(&sink);
+
+    double per_vehicle = 1e9 / (double(reps) * n);
+    double ns_rows = t_rows.best(Eigen::REAL_TIMER) * per_vehicle;
+    double ns_update = t_update.best(Eigen::REAL_TIMER) * per_vehicle;
+    double ns_filled_rows = t_filled_rows.best(Eigen::REAL_TIMER) * per_vehicle;
+    double ns_filled_update = t_filled_update.best(Eigen::REAL_TIMER) * per_vehicle;
+    double ns_assign = t_assign.best(Eigen::REAL_TIMER) * per_vehicle;
+    cout << n << " vehicles" << endl;
+    cout << "  row by row                " << ns_rows << " ns/vehicle" << endl;
+    cout << "  update()                  " << ns_update << " ns/vehicle ("
+         << ns_rows / ns_update << "x)" << endl;
+    cout << "  filled rows, row by row   " << ns_filled_rows << " ns/vehicle" << endl;
+    cout << "  filled columns, update()  " << ns_filled_update << " ns/vehicle ("
+         << ns_filled_rows / ns_filled_update << "x)" << endl;
+    cout << "  assign() + update()       " << ns_assign << " ns/vehicle (copying rows into columns)"
+         << endl;
+    cout << "  mismatches                " << mismatches << "/" << n << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Levels below LOG_COMPILED_LEVEL are removed at compile time: the LOG_*
+// macros test it as a constant, so neither the call nor its arguments are
+// compiled in. 0 keeps everything, 4 removes all logging.
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+#define LOG_AT(logger, level, ...)                                        \
+  do {                                                                    \
+    if ((level) >= LOG_COMPILED_LEVEL && (logger).enabled(level)) {       \
+      (logger).log((level), __VA_ARGS__);                                 \
+    }                                                                     \
+  } while (0)
+#define LOG_DEBUG(logger, ...) LOG_AT(logger, AsyncLogger::kDebug, __VA_ARGS__)
+#define LOG_INFO(logger, ...) LOG_AT(logger, AsyncLogger::kInfo, __VA_ARGS__)
+#define LOG_WARN(logger, ...) LOG_AT(logger, AsyncLogger::kWarn, __VA_ARGS__)
+#define LOG_ERROR(logger, ...) LOG_AT(logger, AsyncLogger::kError, __VA_ARGS__)
+
+// Logger for a thread that must not wait on output. log() writes a fixed
+// size binary record -- time, level, format string pointer and up to four
+// numeric arguments -- into a lock-free single producer, single consumer
+// ring buffer. A background thread drains the ring, formats the records and
+// writes them to the output stream. It polls, sleeping longer the longer
+// the ring stays empty, so that log() never has to wake it.
+//
+// Records are stamped with the CPU's time stamp counter where there is one,
+// a fraction of the cost of reading steady_clock, and the writer converts
+// the ticks to seconds against steady_clock. This assumes an invariant
+// TSC, which x86 CPUs have had for over a decade.
+//
+// Only one thread may call log(). Format strings must outlive the logger
+// (string literals do); each "{}" in them is replaced by the next argument.
+// When the ring is full, records are dropped and counted rather than
+// blocking the caller.
+class AsyncLogger {
+ public:
+  enum Level { kDebug, kInfo, kWarn, kError, kOff };
+  static const int kMaxArgs = 4;
+
+  // capacity is rounded up to a power of two.
+  explicit AsyncLogger(std::ostream &out = std::cout, int capacity = 4096)
+      : out_(out), level_(kDebug), seconds_per_tick_(0), head_(0), tail_cache_(0), tail_(0),
+        dropped_(0), stop_(false) {
+    int n = 1;
+    while (n < capacity) n *= 2;
+    records_.resize(n);
+    mask_ = n - 1;
+    start_ = std::chrono::steady_clock::now();
+    start_ticks_ = ticks();
+    writer_ = std::thread(&AsyncLogger::run, this);
+  }
+
+  // Writes out everything logged so far.
+  ~AsyncLogger() {
+    stop_.store(true, std::memory_order_release);
+    writer_.join();
+  }
+
+  void setLevel(Level level) { level_.store(level, std::memory_order_relaxed); }
+  Level level() const { return Level(level_.load(std::memory_order_relaxed)); }
+  bool enabled(Level level) const {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+  // Records dropped because the ring was full.
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  template <class... Args>
+  void log(Level level, const char *format, Args... args) {
+    static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    // The writer's tail is only read when the ring looks full from the
+    // last one read, so that its cache line mostly stays with the writer.
+    if (head - tail_cache_ > mask_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ > mask_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    Record &r = records_[head & mask_];
+    r.ticks = ticks();
+    r.level = level;
+    r.format = format;
+    r.num_args = sizeof...(Args);
+    double values[] = {double(args)..., 0};
+    for (int i = 0; i < int(sizeof...(Args)); i++) r.args[i] = values[i];
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Waits until the writer thread has written out every record logged so
+  // far. For the logging thread, e.g. before exiting.
+  void flush() {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    while (tail_.load(std::memory_order_acquire) < head) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  static Level parseLevel(const std::string &name, Level fallback) {
+    static const char *names[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = 0; i <= kOff; i++) {
+      if (name == names[i]) return Level(i);
+    }
+    return fallback;
+  }
+
+ private:
+  struct Record {
+    uint64_t ticks;  // time stamp, see ticks()
+    int level;
+    int num_args;
+    const char *format;
+    double args[kMaxArgs];
+  };
+
+  // The time stamp counter, or where there is none, steady_clock's ticks.
+  static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+
+  void run() {
+    // Right after records the writer polls every kMinSleep, doubling up to
+    // kMaxSleep while the ring stays empty.
+    const std::chrono::microseconds kMinSleep(50), kMaxSleep(1000);
+    std::chrono::microseconds sleep = kMinSleep;
+    for (;;) {
+      bool stopping = stop_.load(std::memory_order_acquire);
+      uint64_t head = head_.load(std::memory_order_acquire);
+      uint64_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head) {
+        if (stopping) break;
+        std::this_thread::sleep_for(sleep);
+        sleep = std::min(2 * sleep, kMaxSleep);
+        continue;
+      }
+      sleep = kMinSleep;
+      // Seconds per tick, measured over the logger's lifetime so far
+      uint64_t now_ticks = ticks();
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+      if (now_ticks > start_ticks_) seconds_per_tick_ = elapsed.count() / (now_ticks - start_ticks_);
+      for (; tail != head; tail++) {
+        write(records_[tail & mask_]);
+        tail_.store(tail + 1, std::memory_order_release);
+      }
+      out_.flush();
+    }
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped > 0) out_ << "[log] " << dropped << " records dropped" << std::endl;
+  }
+
+  // "<seconds since start> <level letter> <message>"
+  void write(const Record &r) {
+    char prefix[32];
+    double time = double(int64_t(r.ticks - start_ticks_)) * seconds_per_tick_;
+    snprintf(prefix, sizeof(prefix), "%.6f %c ", time, "DIWE"[r.level]);
+    out_ << prefix;
+    int arg = 0;
+    for (const char *p = r.format; *p; p++) {
+      if (p[0] == '{' && p[1] == '}' && arg < r.num_args) {
+        out_ << r.args[arg++];
+        p++;
+      } else {
+        out_.put(*p);
+      }
+    }
+    out_.put('\n');
+  }
+
+  std::ostream &out_;
+  std::atomic<int> level_;
+  std::vector<Record> records_;
+  uint64_t mask_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t start_ticks_;
+  double seconds_per_tick_;  // writer thread only
+  // Written by the logging thread / the writer thread, on separate cache
+  // lines so that they do not slow each other down. The logging thread's
+  // last view of the tail shares head_'s line.
+  alignas(64) std::atomic<uint64_t> head_;
+  uint64_t tail_cache_;
+  alignas(64) std::atomic<uint64_t> tail_;
+  alignas(64) std::atomic<uint64_t> dropped_;
+  std::atomic<bool> stop_;
+  std::thread writer_;
+};
+
+#endif  // ASYNC_LOGGER_H
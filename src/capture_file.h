@@ -0,0 +1,509 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Capture file: the websocket messages of a planner session with their
+// timestamps, for replaying offline.
+//
+//   CaptureFileHeader
+//   block*       CaptureBlockHeader + zlib-compressed records
+//   index        one CaptureIndexEntry per block
+//   CaptureFileFooter
+//
+// A record is a CaptureRecordHeader followed by the message bytes. The
+// index lets a reader go straight to the block holding any record. If the
+// recording was killed before the index was written, the reader rebuilds
+// it by walking the block headers, dropping a torn last block. An index
+// that disagrees with the block headers or the file size is corrupt, and
+// the file is rejected.
+struct CaptureFileHeader {
+  char magic[8];  // "PPCAPT" followed by zeros
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t start_time;  // ns since the Unix epoch
+  uint64_t reserved;
+};
+
+struct CaptureBlockHeader {
+  uint64_t first_record;
+  uint64_t first_time;
+  uint32_t num_records;
+  uint32_t raw_size;
+  uint32_t compressed_size;
+  uint32_t reserved;
+};
+
+struct CaptureRecordHeader {
+  uint64_t time;  // ns since the Unix epoch
+  uint32_t length;
+  uint16_t kind;
+  uint16_t reserved;
+};
+
+struct CaptureIndexEntry {
+  uint64_t offset;  // of the block header, from the start of the file
+  uint64_t first_record;
+  uint64_t first_time;
+  uint32_t num_records;
+  uint32_t reserved;
+};
+
+struct CaptureFileFooter {
+  uint64_t index_offset;
+  uint64_t num_blocks;
+  uint64_t num_records;
+  char magic[8];  // "PPCAPEND"
+};
+
+// One message read back from a capture file. data points into the buffer
+// the block was decompressed into.
+struct CaptureRecord {
+  enum Kind { kReceived = 1, kSent = 2 };
+  uint16_t kind;
+  uint64_t time;
+  const char *data;
+  size_t length;
+};
+
+namespace capture {
+
+const uint32_t kVersion = 1;
+inline const char *headerMagic() { return "PPCAPT\0\0"; }
+inline const char *footerMagic() { return "PPCAPEND"; }
+
+inline uint64_t wallClockNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+inline bool fail(std::string *error, const std::string &why) {
+  if (error) *error = why;
+  return false;
+}
+
+static_assert(sizeof(CaptureFileHeader) == 32, "CaptureFileHeader layout");
+static_assert(sizeof(CaptureBlockHeader) == 32, "CaptureBlockHeader layout");
+static_assert(sizeof(CaptureRecordHeader) == 16, "CaptureRecordHeader layout");
+static_assert(sizeof(CaptureIndexEntry) == 32, "CaptureIndexEntry layout");
+static_assert(sizeof(CaptureFileFooter) == 32, "CaptureFileFooter layout");
+
+}  // namespace capture
+
+// Writes a capture file. append() only copies the message into the block
+// being filled; full blocks, and blocks older than flush_interval so that
+// little is lost if the process is killed, go to a background thread that
+// compresses and writes them. The calling thread never waits on zlib or
+// the disk. One thread may append.
+class CaptureWriter {
+ public:
+  explicit CaptureWriter(size_t block_size = 256 * 1024, double flush_interval = 1.0)
+      : fd_(-1),
+        block_size_(block_size),
+        flush_interval_(uint64_t(flush_interval * 1e9)),
+        num_records_(0),
+        block_first_(0),
+        block_time_(0),
+        block_records_(0),
+        stop_(false),
+        failed_(false) {}
+  ~CaptureWriter() { close(); }
+
+  bool open(const std::string &path, std::string *error = 0) {
+    close();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return capture::fail(error, "cannot create " + path);
+    CaptureFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, capture::headerMagic(), sizeof(h.magic));
+    h.version = capture::kVersion;
+    h.header_size = sizeof(h);
+    h.start_time = capture::wallClockNs();
+    if (::write(fd, &h, sizeof(h)) != ssize_t(sizeof(h))) {
+      ::close(fd);
+      return capture::fail(error, "error writing " + path);
+    }
+    fd_ = fd;
+    path_ = path;
+    offset_ = sizeof(h);
+    num_records_ = 0;
+    index_.clear();
+    stop_ = false;
+    failed_ = false;
+    startBlock();
+    writer_ = std::thread(&CaptureWriter::run, this);
+    return true;
+  }
+
+  bool isOpen() const { return fd_ >= 0; }
+  uint64_t numRecords() const { return num_records_; }
+
+  void append(uint16_t kind, uint64_t time, const char *data, size_t length) {
+    if (fd_ < 0) return;
+    if (block_records_ == 0) block_time_ = time;
+    CaptureRecordHeader r = {time, uint32_t(length), kind, 0};
+    block_.append(reinterpret_cast<const char *>(&r), sizeof(r));
+    block_.append(data, length);
+    block_records_++;
+    num_records_++;
+    if (block_.size() >= block_size_ || time - block_time_ >= flush_interval_) {
+      queueBlock();
+    }
+  }
+
+  // Writes out the last block, the index and the footer. Returns false if
+  // anything could not be written.
+  bool close(std::string *error = 0) {
+    if (fd_ < 0) return true;
+    if (block_records_ > 0) queueBlock();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+
+    CaptureFileFooter f;
+    memset(&f, 0, sizeof(f));
+    f.index_offset = offset_;
+    f.num_blocks = index_.size();
+    f.num_records = num_records_;
+    memcpy(f.magic, capture::footerMagic(), sizeof(f.magic));
+    if (!failed_) writeAll(index_.data(), index_.size() * sizeof(CaptureIndexEntry));
+    if (!failed_) writeAll(&f, sizeof(f));
+    bool ok = !failed_ && ::close(fd_) == 0;
+    if (failed_) ::close(fd_);
+    fd_ = -1;
+    return ok ? true : capture::fail(error, "error writing " + path_);
+  }
+
+ private:
+  struct Block {
+    std::string raw;
+    uint64_t first_record, first_time;
+    uint32_t num_records;
+  };
+
+  void startBlock() {
+    block_.clear();
+    block_.reserve(block_size_ + 4096);
+    block_first_ = num_records_;
+    block_records_ = 0;
+  }
+
+  void queueBlock() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(Block());
+      Block &b = queue_.back();
+      b.raw.swap(block_);
+      b.first_record = block_first_;
+      b.first_time = block_time_;
+      b.num_records = block_records_;
+      // Continue in a buffer the writer is done with, so that a steady
+      // stream of blocks does not allocate.
+      if (!spare_.empty()) {
+        block_.swap(spare_.back());
+        spare_.pop_back();
+      }
+    }
+    wake_.notify_one();
+    startBlock();
+  }
+
+  void run() {
+    std::vector<Bytef> compressed;
+    for (;;) {
+      Block b;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        b = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      if (!failed_) writeBlock(b, &compressed);
+      b.raw.clear();
+      std::lock_guard<std::mutex> lock(mutex_);
+      spare_.push_back(std::move(b.raw));
+    }
+  }
+
+  void writeBlock(const Block &b, std::vector<Bytef> *compressed) {
+    uLongf size = compressBound(b.raw.size());
+    compressed->resize(size);
+    if (compress2(compressed->data(), &size,
+                  reinterpret_cast<const Bytef *>(b.raw.data()), b.raw.size(),
+                  Z_BEST_SPEED) != Z_OK) {
+      failed_ = true;
+      return;
+    }
+    CaptureBlockHeader h = {b.first_record, b.first_time, b.num_records,
+                            uint32_t(b.raw.size()), uint32_t(size), 0};
+    CaptureIndexEntry e = {offset_, b.first_record, b.first_time, b.num_records, 0};
+    if (writeAll(&h, sizeof(h)) && writeAll(compressed->data(), size)) {
+      index_.push_back(e);
+    }
+  }
+
+  bool writeAll(const void *data, size_t n) {
+    const char *p = static_cast<const char *>(data);
+    while (n > 0) {
+      ssize_t k = ::write(fd_, p, n);
+      if (k <= 0) {
+        failed_ = true;
+        return false;
+      }
+      p += k;
+      n -= k;
+      offset_ += k;
+    }
+    return true;
+  }
+
+  int fd_;
+  std::string path_;
+  size_t block_size_;
+  uint64_t flush_interval_;
+  // Event loop side
+  uint64_t num_records_;
+  std::string block_;
+  uint64_t block_first_, block_time_;
+  uint32_t block_records_;
+  // Writer side; offset_ and index_ are the event loop's again after the
+  // writer has been joined
+  uint64_t offset_;
+  std::vector<CaptureIndexEntry> index_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Block> queue_;
+  std::vector<std::string> spare_;
+  bool stop_;
+  bool failed_;
+  std::thread writer_;
+};
+
+// A memory mapped capture file. readBlock() is const and decompresses into
+// a buffer the caller owns, so threads can read different blocks at once.
+class CaptureReader {
+ public:
+  CaptureReader()
+      : base_(0), size_(0), num_records_(0), start_time_(0), rebuilt_(false), lost_bytes_(0) {}
+  ~CaptureReader() { close(); }
+
+  static bool isCaptureFile(const std::string &path) {
+    char magic[8] = {0};
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::read(fd, magic, sizeof(magic)) == ssize_t(sizeof(magic)) &&
+              memcmp(magic, capture::headerMagic(), sizeof(magic)) == 0;
+    ::close(fd);
+    return ok;
+  }
+
+  bool open(const std::string &path, std::string *error = 0) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return capture::fail(error, "cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CaptureFileHeader)) {
+      ::close(fd);
+      return capture::fail(error, path + " is too small to be a capture file");
+    }
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return capture::fail(error, "cannot map " + path);
+    base_ = static_cast<const char *>(base);
+    size_ = st.st_size;
+    const CaptureFileHeader &h = *reinterpret_cast<const CaptureFileHeader *>(base_);
+    if (memcmp(h.magic, capture::headerMagic(), sizeof(h.magic)) != 0 ||
+        h.version != capture::kVersion || h.header_size != sizeof(h)) {
+      close();
+      return capture::fail(error, path + ": not a capture file of a supported version");
+    }
+    start_time_ = h.start_time;
+    std::string why;
+    if (hasFooter()) {
+      if (!readIndex(&why)) {
+        close();
+        return capture::fail(error, path + ": " + why);
+      }
+    } else {
+      scanBlocks();
+    }
+    return true;
+  }
+
+  void close() {
+    if (base_) munmap(const_cast<char *>(base_), size_);
+    base_ = 0;
+    size_ = 0;
+    index_.clear();
+    num_records_ = 0;
+    rebuilt_ = false;
+    lost_bytes_ = 0;
+  }
+
+  bool isOpen() const { return base_ != 0; }
+  uint64_t startTime() const { return start_time_; }
+  uint64_t numRecords() const { return num_records_; }
+  size_t numBlocks() const { return index_.size(); }
+  const CaptureIndexEntry &block(size_t b) const { return index_[b]; }
+  // Whether the file had no index, because the recording was not closed,
+  // and the index was rebuilt from the block headers.
+  bool indexRebuilt() const { return rebuilt_; }
+  // Bytes after the last whole block of a rebuilt index (a torn block),
+  // which are not read.
+  uint64_t lostBytes() const { return lost_bytes_; }
+
+  // The block holding record i.
+  size_t blockOf(uint64_t i) const {
+    size_t lo = 0, hi = index_.size();
+    while (hi - lo > 1) {
+      size_t mid = (lo + hi) / 2;
+      if (index_[mid].first_record <= i) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // Decompresses block b into raw and appends its records to records;
+  // they point into raw. open() has checked that the block lies within
+  // the file.
+  bool readBlock(size_t b, std::string *raw, std::vector<CaptureRecord> *records,
+                 std::string *error = 0) const {
+    if (b >= index_.size()) return capture::fail(error, "no such block");
+    const CaptureBlockHeader h = load<CaptureBlockHeader>(index_[b].offset);
+    raw->resize(h.raw_size);
+    uLongf size = h.raw_size;
+    const Bytef *src = reinterpret_cast<const Bytef *>(base_ + index_[b].offset + sizeof(h));
+    if (uncompress(reinterpret_cast<Bytef *>(&(*raw)[0]), &size, src, h.compressed_size) !=
+            Z_OK ||
+        size != h.raw_size) {
+      return capture::fail(error, "corrupt block");
+    }
+    size_t pos = 0;
+    for (uint32_t k = 0; k < h.num_records; k++) {
+      if (pos + sizeof(CaptureRecordHeader) > size) return capture::fail(error, "corrupt block");
+      CaptureRecordHeader r;
+      memcpy(&r, raw->data() + pos, sizeof(r));
+      pos += sizeof(r);
+      if (pos + r.length > size) return capture::fail(error, "corrupt block");
+      CaptureRecord rec = {r.kind, r.time, raw->data() + pos, r.length};
+      records->push_back(rec);
+      pos += r.length;
+    }
+    return true;
+  }
+
+ private:
+  // Block headers and index entries follow compressed data, so they are
+  // not aligned; read them with memcpy.
+  template <typename T>
+  T load(uint64_t offset) const {
+    T v;
+    memcpy(&v, base_ + offset, sizeof(v));
+    return v;
+  }
+
+  CaptureFileFooter footer() const {
+    return load<CaptureFileFooter>(size_ - sizeof(CaptureFileFooter));
+  }
+
+  bool hasFooter() const {
+    return size_ >= sizeof(CaptureFileHeader) + sizeof(CaptureFileFooter) &&
+           memcmp(footer().magic, capture::footerMagic(), sizeof(footer().magic)) == 0;
+  }
+
+  // Whether a block header at offset, and the compressed data after it,
+  // end by `end`, with record numbering carrying on from first_record and
+  // sizes zlib could have produced. end > offset.
+  bool checkBlock(uint64_t offset, uint64_t end, uint64_t first_record) const {
+    if (end - offset < sizeof(CaptureBlockHeader)) return false;
+    const CaptureBlockHeader h = load<CaptureBlockHeader>(offset);
+    // zlib compresses at most about 1032:1
+    return h.first_record == first_record &&
+           h.compressed_size <= end - offset - sizeof(h) &&
+           h.raw_size <= uint64_t(h.compressed_size) * 1032 + 64;
+  }
+
+  // Reads the index the footer points to, checking every entry against
+  // its block header and the file size, so that readBlock() cannot read
+  // outside the mapping.
+  bool readIndex(std::string *why) {
+    const CaptureFileFooter f = footer();
+    const uint64_t index_end = size_ - sizeof(f);
+    if (f.index_offset < sizeof(CaptureFileHeader) || f.index_offset > index_end ||
+        f.num_blocks != (index_end - f.index_offset) / sizeof(CaptureIndexEntry) ||
+        (index_end - f.index_offset) % sizeof(CaptureIndexEntry) != 0) {
+      *why = "corrupt footer";
+      return false;
+    }
+    index_.resize(f.num_blocks);
+    if (f.num_blocks > 0) {
+      memcpy(&index_[0], base_ + f.index_offset, f.num_blocks * sizeof(CaptureIndexEntry));
+    }
+    uint64_t offset = sizeof(CaptureFileHeader), records = 0;
+    for (const CaptureIndexEntry &e : index_) {
+      // Blocks follow each other in the order of the index
+      if (e.offset < offset || e.offset >= f.index_offset || e.first_record != records ||
+          !checkBlock(e.offset, f.index_offset, records) ||
+          load<CaptureBlockHeader>(e.offset).num_records != e.num_records) {
+        *why = "corrupt index entry";
+        return false;
+      }
+      offset = e.offset + sizeof(CaptureBlockHeader) +
+               load<CaptureBlockHeader>(e.offset).compressed_size;
+      records += e.num_records;
+    }
+    if (records != f.num_records) {
+      *why = "corrupt footer";
+      return false;
+    }
+    num_records_ = f.num_records;
+    return true;
+  }
+
+  // Rebuilds the index of a capture that was not closed, up to the first
+  // block that does not fit in the file.
+  void scanBlocks() {
+    rebuilt_ = true;
+    uint64_t offset = sizeof(CaptureFileHeader);
+    while (offset < size_ && checkBlock(offset, size_, num_records_)) {
+      const CaptureBlockHeader h = load<CaptureBlockHeader>(offset);
+      CaptureIndexEntry e = {offset, h.first_record, h.first_time, h.num_records, 0};
+      index_.push_back(e);
+      num_records_ += h.num_records;
+      offset += sizeof(h) + h.compressed_size;
+    }
+    lost_bytes_ = size_ - offset;
+  }
+
+  const char *base_;
+  size_t size_;
+  std::vector<CaptureIndexEntry> index_;
+  uint64_t num_records_;
+  uint64_t start_time_;
+  bool rebuilt_;
+  uint64_t lost_bytes_;
+};
+
+#endif  // CAPTURE_FILE_H
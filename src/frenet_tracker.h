@@ -0,0 +1,118 @@
+#ifndef FRENET_TRACKER_H
+#define FRENET_TRACKER_H
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include "road_map.h"
+
+// Frenet conversion for objects that are seen every frame (the ego car and
+// the sensor fusion cars). Objects move a few meters per 20 ms frame, so the
+// segment found for an object last frame is remembered in a Hint the caller
+// keeps with the object, and the search starts from there; the spatial
+// index is only used for new objects or ones that jumped.
+class FrenetTracker {
+ public:
+  // Per-object state: the segment of the last conversion, -1 for none.
+  struct Hint {
+    int segment;
+    Hint() : segment(-1) {}
+  };
+
+  explicit FrenetTracker(const RoadMap &road_map)
+      : map_(road_map), warm_hits_(0), global_searches_(0) {}
+
+  // Frenet s,d of the object at x,y; updates its hint. Projects onto the
+  // same segment as RoadMap::getFrenet().
+  std::array<double, 2> getFrenet(Hint *hint, double x, double y) {
+    int seg = -1;
+    if (hint->segment >= 0 && hint->segment < map_.size()) {
+      seg = descend(hint->segment, x, y);
+    }
+    if (seg < 0) {
+      seg = map_.index().closestSegment(x, y);
+      global_searches_++;
+    } else {
+      warm_hits_++;
+    }
+    hint->segment = seg;
+    return map_.frenetOnSegment(seg, x, y);
+  }
+
+  // Converts n objects at once, writing their s,d to s_out/d_out.
+  void getFrenet(int n, Hint *hints, const double *xs, const double *ys,
+                 double *s_out, double *d_out) {
+    for (int k = 0; k < n; k++) {
+      std::array<double, 2> sd = getFrenet(&hints[k], xs[k], ys[k]);
+      s_out[k] = sd[0];
+      d_out[k] = sd[1];
+    }
+  }
+
+  long warmHits() const { return warm_hits_; }
+  long globalSearches() const { return global_searches_; }
+
+ private:
+  // Largest number of segments walked from the hint, and the largest
+  // distance off the road, before the object counts as having jumped.
+  static const int kMaxSteps = 3;
+  static constexpr double kMaxOffset = 20.0;
+
+  // Squared distance from x,y to segment i, clamped to its ends, computed
+  // as WaypointIndex does so that ties break the same way.
+  double distance2(int i, double x, double y) const {
+    const RoadSegment &a = map_.segment(i);
+    const RoadSegment &b = map_.segment(i + 1 == map_.size() ? 0 : i + 1);
+    double ux = b.x - a.x, uy = b.y - a.y;
+    double px = x - a.x, py = y - a.y;
+    double uu = ux * ux + uy * uy;
+    double t = (uu > 0) ? (px * ux + py * uy) / uu : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    double ex = px - t * ux, ey = py - t * uy;
+    return ex * ex + ey * ey;
+  }
+
+  // Whether segment i (at squared distance d2) is closer than the best so
+  // far, with WaypointIndex's tie break on the lower index.
+  static bool closer(int i, double d2, int best, double best_d2) {
+    return d2 < best_d2 || (d2 == best_d2 && i < best);
+  }
+
+  // Closest segment, found by moving from `seg` to a closer neighbour
+  // until neither neighbour is closer, or -1 when that is not within
+  // reach. Both neighbours are compared: on the inside of a corner the
+  // projection falls within the spans of two segments, and the nearer one
+  // is the one RoadMap::getFrenet() projects onto.
+  int descend(int seg, double x, double y) const {
+    int n = map_.size();
+    double d2 = distance2(seg, x, y);
+    for (int step = 0; step <= kMaxSteps; step++) {
+      int prev = (seg == 0) ? n - 1 : seg - 1;
+      int next = (seg == n - 1) ? 0 : seg + 1;
+      double prev_d2 = distance2(prev, x, y);
+      double next_d2 = distance2(next, x, y);
+      int best = seg;
+      double best_d2 = d2;
+      if (closer(prev, prev_d2, best, best_d2)) {
+        best = prev;
+        best_d2 = prev_d2;
+      }
+      if (closer(next, next_d2, best, best_d2)) {
+        best = next;
+        best_d2 = next_d2;
+      }
+      if (best == seg) {
+        return (d2 <= kMaxOffset * kMaxOffset) ? seg : -1;
+      }
+      seg = best;
+      d2 = best_d2;
+    }
+    return -1;
+  }
+
+  const RoadMap &map_;
+  long warm_hits_;
+  long global_searches_;
+};
+
+#endif  // FRENET_TRACKER_H
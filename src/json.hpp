@@ -6488,6 +6488,138 @@ class basic_json
         return parse(std::begin(c), std::end(c), cb);
     }
 
+    /*!
+    @brief base class for SAX event handlers
+
+    A SAX handler receives the values of a JSON text as a sequence of events
+    instead of a DOM: @ref sax_parse calls the member function matching each
+    token as it is read. Derive from this class and hide the functions for
+    the events of interest; the others accept and ignore their event.
+
+    Every function returns whether to continue. Returning `false` stops the
+    parse, and @ref sax_parse returns `false`.
+
+    Strings and object keys are passed as the raw bytes between the quotes,
+    pointing into the input (or, for the last few bytes of the input, into
+    the lexer's buffer). Escape sequences are not decoded, and the pointer is
+    only valid during the call. Numbers arrive with the same type the DOM
+    parser would store them as; non-finite floats arrive as null.
+
+    @note Nothing in the parse allocates on the heap. The only exception is
+    a token that ends within the last few bytes of the input and does not
+    fit the lexer's small string buffer, which are copied there.
+    */
+    struct sax_handler
+    {
+        bool null()
+        {
+            return true;
+        }
+        bool boolean(bool)
+        {
+            return true;
+        }
+        bool number_integer(number_integer_t)
+        {
+            return true;
+        }
+        bool number_unsigned(number_unsigned_t)
+        {
+            return true;
+        }
+        bool number_float(number_float_t)
+        {
+            return true;
+        }
+        bool string(const char*, std::size_t)
+        {
+            return true;
+        }
+        bool key(const char*, std::size_t)
+        {
+            return true;
+        }
+        bool start_object()
+        {
+            return true;
+        }
+        bool end_object()
+        {
+            return true;
+        }
+        bool start_array()
+        {
+            return true;
+        }
+        bool end_array()
+        {
+            return true;
+        }
+    };
+
+    /*!
+    @brief parse an iterator range with contiguous storage as SAX events
+
+    Reads the JSON text in [first, last) with the same lexer and grammar as
+    @ref parse(IteratorType, IteratorType, const parser_callback_t), but
+    instead of building a value, calls the member functions of @a handler
+    for each value, key, and object or array boundary in document order.
+    For example, `{"s":124.8,"d":[6]}` produces start_object, key("s"),
+    number_float(124.8), key("d"), start_array, number_unsigned(6),
+    end_array, end_object.
+
+    @pre The iterator range is contiguous and each element has a size of 1
+    byte (the latter is enforced with a static assertion).
+
+    @tparam IteratorType iterator of container with contiguous storage
+    @tparam SAX handler type providing the functions of @ref sax_handler
+    @param[in] first  begin of the range to parse (included)
+    @param[in] last  end of the range to parse (excluded)
+    @param[in,out] handler  receives the events
+
+    @return `true` if the whole input was read, `false` if a handler
+    function stopped the parse
+
+    @throw std::invalid_argument in case of parse errors, like @ref parse
+
+    @complexity Linear in the length of the input.
+    */
+    template<class IteratorType, class SAX, typename std::enable_if<
+                 std::is_base_of<
+                     std::random_access_iterator_tag,
+                     typename std::iterator_traits<IteratorType>::iterator_category>::value, int>::type = 0>
+    static bool sax_parse(IteratorType first, IteratorType last, SAX* handler)
+    {
+        static_assert(sizeof(typename std::iterator_traits<IteratorType>::value_type) == 1,
+                      "each element in the iterator range must have the size of 1 byte");
+
+        if (std::distance(first, last) <= 0)
+        {
+            return sax_parser<SAX>(reinterpret_cast<const typename lexer::lexer_char_t*>(""),
+                                   0, handler).parse();
+        }
+
+        return sax_parser<SAX>(reinterpret_cast<const typename lexer::lexer_char_t*>(&(*first)),
+                               static_cast<size_t>(std::distance(first, last)), handler).parse();
+    }
+
+    /*!
+    @brief parse a container with contiguous storage as SAX events
+
+    @copydetails sax_parse(IteratorType, IteratorType, SAX*)
+    */
+    template<class ContiguousContainer, class SAX, typename std::enable_if<
+                 not std::is_pointer<ContiguousContainer>::value and
+                 std::is_base_of<
+                     std::random_access_iterator_tag,
+                     typename std::iterator_traits<decltype(std::begin(std::declval<ContiguousContainer const>()))>::iterator_category>::value
+                 , int>::type = 0>
+    static bool sax_parse(const ContiguousContainer& c, SAX* handler)
+    {
+        // delegate the call to the iterator-range overload
+        return sax_parse(std::begin(c), std::end(c), handler);
+    }
+
     /*!
     @brief deserialize from stream
 
@@ -10915,6 +11047,18 @@ basic_json_parser_74:
                             static_cast<size_t>(m_cursor - m_start));
         }
 
+        /// return pointer to the first byte of the last read token
+        const lexer_char_t* get_token_begin() const noexcept
+        {
+            return m_start;
+        }
+
+        /// return pointer past the last byte of the last read token
+        const lexer_char_t* get_token_end() const noexcept
+        {
+            return m_cursor;
+        }
+
         /*!
         @brief return string value for string tokens
 
@@ -11631,6 +11775,250 @@ basic_json_parser_74:
         lexer m_lexer;
     };
 
+    /*!
+    @brief syntax analysis reporting SAX events
+
+    Same grammar and error messages as @ref parser, but the values are
+    handed to a SAX handler (see @ref sax_handler) as they are read instead
+    of being collected in a basic_json.
+    */
+    template<class SAX>
+    class sax_parser
+    {
+      public:
+        sax_parser(const typename lexer::lexer_char_t* buff, const size_t len, SAX* handler)
+            : sax(handler), m_lexer(buff, len)
+        {}
+
+        /// public parser interface
+        bool parse()
+        {
+            // read first token
+            get_token();
+
+            if (not parse_internal())
+            {
+                return false;
+            }
+
+            expect(lexer::token_type::end_of_input);
+            return true;
+        }
+
+      private:
+        /// the actual parser; returns false if the handler stopped it
+        bool parse_internal()
+        {
+            switch (last_token)
+            {
+                case lexer::token_type::begin_object:
+                {
+                    if (not sax->start_object())
+                    {
+                        return false;
+                    }
+
+                    // read next token
+                    get_token();
+
+                    // closing } -> we are done
+                    if (last_token == lexer::token_type::end_object)
+                    {
+                        get_token();
+                        return sax->end_object();
+                    }
+
+                    // no comma is expected here
+                    unexpect(lexer::token_type::value_separator);
+
+                    // otherwise: parse key-value pairs
+                    do
+                    {
+                        if (last_token == lexer::token_type::value_separator)
+                        {
+                            get_token();
+                        }
+
+                        // key, without the quotes
+                        expect(lexer::token_type::value_string);
+                        if (not sax->key(token_begin() + 1, token_length() - 2))
+                        {
+                            return false;
+                        }
+
+                        // parse separator (:)
+                        get_token();
+                        expect(lexer::token_type::name_separator);
+
+                        // parse value
+                        get_token();
+                        if (not parse_internal())
+                        {
+                            return false;
+                        }
+                    }
+                    while (last_token == lexer::token_type::value_separator);
+
+                    // closing }
+                    expect(lexer::token_type::end_object);
+                    get_token();
+                    return sax->end_object();
+                }
+
+                case lexer::token_type::begin_array:
+                {
+                    if (not sax->start_array())
+                    {
+                        return false;
+                    }
+
+                    // read next token
+                    get_token();
+
+                    // closing ] -> we are done
+                    if (last_token == lexer::token_type::end_array)
+                    {
+                        get_token();
+                        return sax->end_array();
+                    }
+
+                    // no comma is expected here
+                    unexpect(lexer::token_type::value_separator);
+
+                    // otherwise: parse values
+                    do
+                    {
+                        if (last_token == lexer::token_type::value_separator)
+                        {
+                            get_token();
+                        }
+
+                        if (not parse_internal())
+                        {
+                            return false;
+                        }
+                    }
+                    while (last_token == lexer::token_type::value_separator);
+
+                    // closing ]
+                    expect(lexer::token_type::end_array);
+                    get_token();
+                    return sax->end_array();
+                }
+
+                case lexer::token_type::literal_null:
+                {
+                    get_token();
+                    return sax->null();
+                }
+
+                case lexer::token_type::value_string:
+                {
+                    // the string is only valid until the next token is read
+                    const bool result = sax->string(token_begin() + 1, token_length() - 2);
+                    get_token();
+                    return result;
+                }
+
+                case lexer::token_type::literal_true:
+                {
+                    get_token();
+                    return sax->boolean(true);
+                }
+
+                case lexer::token_type::literal_false:
+                {
+                    get_token();
+                    return sax->boolean(false);
+                }
+
+                case lexer::token_type::value_unsigned:
+                case lexer::token_type::value_integer:
+                case lexer::token_type::value_float:
+                {
+                    // numbers are stored in place in a basic_json, which
+                    // does not allocate for them
+                    basic_json number;
+                    if (not m_lexer.get_number(number, last_token))
+                    {
+                        JSON_THROW(std::invalid_argument("parse error - unexpected '" +
+                                                         m_lexer.get_token_string() + "'"));
+                    }
+                    get_token();
+
+                    switch (number.m_type)
+                    {
+                        case value_t::number_unsigned:
+                            return sax->number_unsigned(number.m_value.number_unsigned);
+                        case value_t::number_integer:
+                            return sax->number_integer(number.m_value.number_integer);
+                        case value_t::number_float:
+                            return sax->number_float(number.m_value.number_float);
+                        default:
+                            return sax->null();
+                    }
+                }
+
+                default:
+                {
+                    // the last token was unexpected
+                    unexpect(last_token);
+                    return false;
+                }
+            }
+        }
+
+        const char* token_begin() const
+        {
+            return reinterpret_cast<const char*>(m_lexer.get_token_begin());
+        }
+
+        std::size_t token_length() const
+        {
+            return static_cast<std::size_t>(m_lexer.get_token_end() - m_lexer.get_token_begin());
+        }
+
+        /// get next token from lexer
+        typename lexer::token_type get_token()
+        {
+            last_token = m_lexer.scan();
+            return last_token;
+        }
+
+        void expect(typename lexer::token_type t) const
+        {
+            if (t != last_token)
+            {
+                std::string error_msg = "parse error - unexpected ";
+                error_msg += (last_token == lexer::token_type::parse_error ? ("'" +  m_lexer.get_token_string() +
+                              "'") :
+                              lexer::token_type_name(last_token));
+                error_msg += "; expected " + lexer::token_type_name(t);
+                JSON_THROW(std::invalid_argument(error_msg));
+            }
+        }
+
+        void unexpect(typename lexer::token_type t) const
+        {
+            if (t == last_token)
+            {
+                std::string error_msg = "parse error - unexpected ";
+                error_msg += (last_token == lexer::token_type::parse_error ? ("'" +  m_lexer.get_token_string() +
+                              "'") :
+                              lexer::token_type_name(last_token));
+                JSON_THROW(std::invalid_argument(error_msg));
+            }
+        }
+
+      private:
+        /// the handler receiving the events
+        SAX* sax;
+        /// the type of the last read token
+        typename lexer::token_type last_token = lexer::token_type::uninitialized;
+        /// the lexer
+        lexer m_lexer;
+    };
+
   public:
     /*!
     @brief JSON Pointer
@@ -0,0 +1,114 @@
+#ifndef LANE_OCCUPANCY_H
+#define LANE_OCCUPANCY_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "traffic_snapshot.h"
+
+// The cars of one frame bucketed by lane and sorted by s within each lane,
+// so that questions about a lane -- who is ahead of or behind a given s, is
+// anyone within a gap -- are binary searches instead of scans of the whole
+// sensor fusion table. The build is itself a pass over the table, so it
+// pays off only for many questions per frame; the planner's lane change
+// decision asks a handful, and scans (lane_bench).
+//
+// Built once per frame from a TrafficSnapshot, keyed either by the cars'
+// current s or by their s projected to the end of the previous path. Cars
+// on a lane line or outside lanes [0, num_lanes) are left out, and so are
+// cars outside the window lo < key < hi if one is given: sorting just the
+// few cars near the ego car keeps the build a single pass over the
+// snapshot. Queries then only see the cars in the window. Storage is kept
+// across frames.
+class LaneOccupancy {
+ public:
+  enum Key { kS, kProjectedS };
+
+  LaneOccupancy() : num_lanes_(0) {}
+
+  void build(const TrafficSnapshot &traffic, int num_lanes, Key key,
+             double lo = -HUGE_VAL, double hi = HUGE_VAL) {
+    num_lanes_ = num_lanes;
+    // The cars in the window and the lanes, in one pass over the snapshot,
+    // then one sort of just those by lane and key.
+    cars_.clear();
+    int n = traffic.size();
+    for (int i = 0; i < n; i++) {
+      double k = (key == kS) ? traffic.s(i) : traffic.projectedS(i);
+      int lane = traffic.lane(i);
+      if (k > lo && k < hi && lane >= 0 && lane < num_lanes) {
+        Car c = {k, traffic.speed(i), i, lane};
+        cars_.push_back(c);
+      }
+    }
+    std::sort(cars_.begin(), cars_.end());
+    start_.resize(num_lanes + 1);
+    int c = 0, m = cars_.size();
+    for (int lane = 0; lane <= num_lanes; lane++) {
+      while (c < m && cars_[c].lane < lane) c++;
+      start_[lane] = c;
+    }
+  }
+
+  int numLanes() const { return num_lanes_; }
+  // Number of cars in a lane.
+  int count(int lane) const { return start_[lane + 1] - start_[lane]; }
+
+  // The car nearest ahead of s in a lane, i.e. with the smallest key > s,
+  // as an index into the snapshot; -1 if there is none.
+  int leader(int lane, double s) const {
+    const Car *c = upper(lane, s);
+    return (c != end(lane)) ? c->index : -1;
+  }
+  // The car nearest behind s in a lane, with the largest key < s; -1 if
+  // there is none.
+  int follower(int lane, double s) const {
+    const Car *c = lower(lane, s);
+    return (c != begin(lane)) ? (c - 1)->index : -1;
+  }
+  // Speed of the leader at s, or `none` if the lane is clear ahead.
+  double leaderSpeed(int lane, double s, double none) const {
+    const Car *c = upper(lane, s);
+    return (c != end(lane)) ? c->speed : none;
+  }
+  // A car in a lane with lo < key < hi, the one with the smallest key; -1
+  // if the gap is clear.
+  int carWithin(int lane, double lo, double hi) const {
+    const Car *c = upper(lane, lo);
+    return (c != end(lane) && c->s < hi) ? c->index : -1;
+  }
+  // Number of cars in a lane ahead of s by less than gap, i.e. with key > s
+  // and key - s < gap.
+  int countAhead(int lane, double s, double gap) const {
+    const Car *first = upper(lane, s), *c = first;
+    while (c != end(lane) && c->s - s < gap) c++;
+    return c - first;
+  }
+
+ private:
+  struct Car {
+    double s;      // sort key: current or projected s
+    double speed;
+    int index;     // row in the snapshot
+    int lane;
+    bool operator<(const Car &o) const { return lane < o.lane || (lane == o.lane && s < o.s); }
+  };
+
+  const Car *begin(int lane) const { return cars_.data() + start_[lane]; }
+  const Car *end(int lane) const { return cars_.data() + start_[lane + 1]; }
+  // First car with key >= s / key > s.
+  const Car *lower(int lane, double s) const {
+    Car probe = {s, 0, 0, lane};
+    return std::lower_bound(begin(lane), end(lane), probe);
+  }
+  const Car *upper(int lane, double s) const {
+    Car probe = {s, 0, 0, lane};
+    return std::upper_bound(begin(lane), end(lane), probe);
+  }
+
+  int num_lanes_;
+  std::vector<Car> cars_;   // lane by lane, each sorted by s
+  std::vector<int> start_;  // first car of each lane, plus the total
+};
+
+#endif  // LANE_OCCUPANCY_H
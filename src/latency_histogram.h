@@ -0,0 +1,78 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Histogram of latencies in nanoseconds with HdrHistogram-style log-linear
+// buckets: values below 16 get a bucket each, and every power of two above
+// is split into 16 equal buckets, so a bucket is never wider than 1/16 of
+// its values. Covers the full uint64_t range in 976 counters held inline.
+//
+// record() is a count leading zeros, a shift and three adds; it does not
+// allocate or lock, so a histogram belongs to one thread.
+class LatencyHistogram {
+ public:
+  static const int kSubBits = 4;
+  static const int kSubBuckets = 1 << kSubBits;
+  static const int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+  LatencyHistogram() { reset(); }
+
+  void reset() {
+    memset(counts_, 0, sizeof(counts_));
+    count_ = sum_ = max_ = 0;
+  }
+
+  void record(uint64_t ns) {
+    counts_[bucketOf(ns)]++;
+    count_++;
+    sum_ += ns;
+    if (ns > max_) max_ = ns;
+  }
+
+  // Adds the values recorded in another histogram, e.g. one per thread.
+  void merge(const LatencyHistogram &o) {
+    for (int b = 0; b < kBuckets; b++) counts_[b] += o.counts_[b];
+    count_ += o.count_;
+    sum_ += o.sum_;
+    if (o.max_ > max_) max_ = o.max_;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? double(sum_) / count_ : 0; }
+
+  // The value at quantile q in [0, 1], as the upper end of its bucket (at
+  // most the largest value recorded). 0 if the histogram is empty.
+  uint64_t quantile(double q) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = uint64_t(q * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; b++) {
+      seen += counts_[b];
+      if (seen >= rank) return bucketUpper(b) < max_ ? bucketUpper(b) : max_;
+    }
+    return max_;
+  }
+
+  static int bucketOf(uint64_t v) {
+    if (v < uint64_t(kSubBuckets)) return int(v);
+    int shift = 63 - __builtin_clzll(v) - kSubBits;
+    return (shift + 1) * kSubBuckets + int((v >> shift) & (kSubBuckets - 1));
+  }
+  // Largest value that falls into bucket b.
+  static uint64_t bucketUpper(int b) {
+    if (b < kSubBuckets) return b;
+    int shift = b / kSubBuckets - 1;
+    uint64_t lower = uint64_t(kSubBuckets + b % kSubBuckets) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+  }
+
+ private:
+  uint64_t counts_[kBuckets];
+  uint64_t count_, sum_, max_;
+};
+
+#endif  // LATENCY_HISTOGRAM_H
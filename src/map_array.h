@@ -0,0 +1,57 @@
+#ifndef MAP_ARRAY_H
+#define MAP_ARRAY_H
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+// Read-only array used for the road map tables. It either owns its elements
+// (tables built at startup) or refers to memory owned by someone else (tables
+// in a memory mapped map file), so lookups do not care where a map came from.
+template <class T>
+class MapArray {
+ public:
+  MapArray() : data_(0), size_(0) {}
+  MapArray(const MapArray &other) { *this = other; }
+  MapArray &operator=(const MapArray &other) {
+    own_ = other.own_;
+    if (other.owned()) {
+      data_ = own_.empty() ? 0 : &own_[0];
+    } else {
+      data_ = other.data_;
+    }
+    size_ = other.size_;
+    return *this;
+  }
+
+  // Takes over the elements of v.
+  void assign(std::vector<T> &v) {
+    own_.swap(v);
+    std::vector<T>().swap(v);
+    data_ = own_.empty() ? 0 : &own_[0];
+    size_ = own_.size();
+  }
+
+  // Refers to n elements at p, which must outlive this array.
+  void attach(const T *p, size_t n) {
+    std::vector<T>().swap(own_);
+    data_ = p;
+    size_ = n;
+  }
+
+  bool owned() const { return data_ == 0 || (!own_.empty() && data_ == &own_[0]); }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T *data() const { return data_; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  const T &back() const { return data_[size_ - 1]; }
+
+ private:
+  std::vector<T> own_;
+  const T *data_;
+  size_t size_;
+};
+
+#endif  // MAP_ARRAY_H
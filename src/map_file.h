@@ -0,0 +1,528 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "road_map.h"
+
+// Waypoint columns as found in data/highway_map.csv: x y s dx dy per line.
+struct MapWaypoints {
+  std::vector<double> x, y, s, dx, dy;
+
+  size_t size() const { return x.size(); }
+  void push_back(double wx, double wy, double ws, double wdx, double wdy) {
+    x.push_back(wx);
+    y.push_back(wy);
+    s.push_back(ws);
+    dx.push_back(wdx);
+    dy.push_back(wdy);
+  }
+};
+
+// Reads a waypoint CSV into wp. Returns false if no waypoint was read.
+inline bool readMapCsv(const std::string &path, MapWaypoints *wp) {
+  std::ifstream in_map_(path.c_str(), std::ifstream::in);
+  std::string line;
+  while (getline(in_map_, line)) {
+    std::istringstream iss(line);
+    double x, y, s, d_x, d_y;
+    if (iss >> x >> y >> s >> d_x >> d_y) {
+      wp->push_back(x, y, s, d_x, d_y);
+    }
+  }
+  return wp->size() > 0;
+}
+
+// s at which a closed loop of waypoints wraps back to 0: the last
+// waypoint's s plus the distance back to the first.
+inline double loopMaxS(const MapWaypoints &wp) {
+  size_t n = wp.size();
+  double ux = wp.x[0] - wp.x[n - 1];
+  double uy = wp.y[0] - wp.y[n - 1];
+  return wp.s[n - 1] + sqrt(ux * ux + uy * uy);
+}
+
+// Binary road map: the waypoints plus every table RoadMap and its
+// WaypointIndex build at startup, laid out so that the file can be memory
+// mapped and used in place, with no parsing and no copying.
+//
+// All values are little endian. The header is followed by these sections,
+// each starting on a 64 byte boundary:
+//
+//   waypoints      MapFileWaypoint[num_waypoints]
+//   segments       RoadSegment[num_waypoints]
+//   segment s      double[num_waypoints]
+//   s buckets      int32[num_buckets + 1]
+//   index points   WaypointIndex::Point[num_waypoints]
+//   index cells    WaypointIndex::Cell[table_size]
+//   index items    WaypointIndex::Segment[num_items]
+//
+// Use map_compiler to convert a CSV map. map_compiler --header writes the
+// same tables as constexpr arrays in a C++ header instead (see EMBED_MAP in
+// CMakeLists.txt), which MapFile::attachTables() can use just the same.
+struct MapFileWaypoint {
+  double x, y, s, dx, dy;
+};
+
+struct MapFileSection {
+  uint64_t offset;  // from the start of the file
+  uint64_t count;   // number of elements
+};
+
+struct MapFileHeader {
+  enum {
+    kWaypoints,
+    kSegments,
+    kSegmentS,
+    kBuckets,
+    kIndexPoints,
+    kIndexCells,
+    kIndexItems,
+    kNumSections
+  };
+
+  char magic[8];  // "PPMAP" followed by zeros
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t file_size;
+  double max_s;
+  double bucket_inv_width;
+  double index_min_x, index_min_y, index_cell;
+  int32_t index_gx_max, index_gy_max, index_num_segments;
+  uint32_t index_table_mask;
+  MapFileSection sections[kNumSections];
+};
+
+// A complete set of road map tables, wherever they live: in a RoadMap
+// built at startup, in a mapped map file or in a generated header.
+struct MapTables {
+  double max_s;
+  double bucket_inv_width;
+  double index_min_x, index_min_y, index_cell;
+  int index_gx_max, index_gy_max, index_num_segments;
+  unsigned index_table_mask;
+  size_t num_waypoints;    // also the number of segments and index points
+  size_t num_buckets;      // entries in buckets, the bucket count + 1
+  size_t num_index_cells;  // index_table_mask + 1
+  size_t num_index_items;
+  const MapFileWaypoint *waypoints;
+  const RoadSegment *segments;
+  const double *segment_s;
+  const int *buckets;
+  const WaypointIndex::Point *index_points;
+  const WaypointIndex::Cell *index_cells;
+  const WaypointIndex::Segment *index_items;
+};
+
+// A memory mapped binary road map. The RoadMap returned by roadMap() refers
+// to the mapping and is valid for the lifetime of the MapFile.
+class MapFile {
+ public:
+  static const uint32_t kVersion = 1;
+  static const uint64_t kAlignment = 64;
+
+  MapFile() : base_(0), size_(0) {}
+  ~MapFile() { close(); }
+
+  // True if the file at path starts with the map file magic.
+  static bool isMapFile(const std::string &path) {
+    char magic[8] = {0};
+    std::ifstream in(path.c_str(), std::ios::binary);
+    in.read(magic, sizeof(magic));
+    return in && memcmp(magic, kMagic(), sizeof(magic)) == 0;
+  }
+
+  bool open(const std::string &path, std::string *error = 0) {
+    close();
+    if (!hostIsLittleEndian()) return fail(error, "big endian hosts are not supported");
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail(error, "cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MapFileHeader)) {
+      ::close(fd);
+      return fail(error, path + " is too small to be a map file");
+    }
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return fail(error, "cannot map " + path);
+    base_ = static_cast<const char *>(base);
+    size_ = st.st_size;
+    std::string why;
+    if (!attach(&why)) {
+      close();
+      return fail(error, path + ": " + why);
+    }
+    return true;
+  }
+
+  void close() {
+    if (base_) {
+      munmap(const_cast<char *>(base_), size_);
+    }
+    base_ = 0;
+    size_ = 0;
+    road_map_ = RoadMap();
+  }
+
+  bool isOpen() const { return base_ != 0; }
+  const RoadMap &roadMap() const { return road_map_; }
+  const MapTables &tables() const { return tables_; }
+
+  // Copies the waypoint columns out of a set of tables, e.g. for
+  // SplineRoadMap.
+  static void waypoints(const MapTables &t, MapWaypoints *wp) {
+    for (size_t i = 0; i < t.num_waypoints; i++) {
+      const MapFileWaypoint &w = t.waypoints[i];
+      wp->push_back(w.x, w.y, w.s, w.dx, w.dy);
+    }
+  }
+  void waypoints(MapWaypoints *wp) const { waypoints(tables_, wp); }
+
+  // Points road_map at the tables in t, which must outlive it.
+  static void attachTables(const MapTables &t, RoadMap *road_map) {
+    RoadMap &m = *road_map;
+    m.max_s_ = t.max_s;
+    m.bucket_inv_width_ = t.bucket_inv_width;
+    m.segments_.attach(t.segments, t.num_waypoints);
+    m.seg_s_.attach(t.segment_s, t.num_waypoints);
+    m.bucket_.attach(t.buckets, t.num_buckets);
+    WaypointIndex &index = m.index_;
+    index.min_x_ = t.index_min_x;
+    index.min_y_ = t.index_min_y;
+    index.cell_ = t.index_cell;
+    index.inv_cell_ = 1.0 / t.index_cell;
+    index.gx_max_ = t.index_gx_max;
+    index.gy_max_ = t.index_gy_max;
+    index.num_segments_ = t.index_num_segments;
+    index.table_mask_ = t.index_table_mask;
+    index.pts_.attach(t.index_points, t.num_waypoints);
+    index.table_.attach(t.index_cells, t.num_index_cells);
+    index.cell_items_.attach(t.index_items, t.num_index_items);
+  }
+
+  // Builds the road map tables for wp and writes them to path.
+  static bool write(const std::string &path, const MapWaypoints &wp,
+                    double max_s, std::string *error = 0) {
+    if (!hostIsLittleEndian()) return fail(error, "big endian hosts are not supported");
+    if (wp.size() < 2) return fail(error, "a map needs at least two waypoints");
+    RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+    std::vector<MapFileWaypoint> waypoints;
+    MapTables t = tablesOf(road_map, wp, &waypoints);
+
+    MapFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic(), sizeof(h.magic));
+    h.version = kVersion;
+    h.header_size = sizeof(MapFileHeader);
+    h.max_s = t.max_s;
+    h.bucket_inv_width = t.bucket_inv_width;
+    h.index_min_x = t.index_min_x;
+    h.index_min_y = t.index_min_y;
+    h.index_cell = t.index_cell;
+    h.index_gx_max = t.index_gx_max;
+    h.index_gy_max = t.index_gy_max;
+    h.index_num_segments = t.index_num_segments;
+    h.index_table_mask = t.index_table_mask;
+
+    // Lay the sections out, then write header and sections in order.
+    const void *data[MapFileHeader::kNumSections];
+    uint64_t elem_size[MapFileHeader::kNumSections];
+    uint64_t offset = align(sizeof(MapFileHeader));
+#define MAP_FILE_SECTION(id, array, n)                        \
+  data[id] = (array);                                         \
+  elem_size[id] = sizeof(*(array));                           \
+  h.sections[id].offset = offset;                             \
+  h.sections[id].count = (n);                                 \
+  offset = align(offset + elem_size[id] * h.sections[id].count)
+    MAP_FILE_SECTION(MapFileHeader::kWaypoints, t.waypoints, t.num_waypoints);
+    MAP_FILE_SECTION(MapFileHeader::kSegments, t.segments, t.num_waypoints);
+    MAP_FILE_SECTION(MapFileHeader::kSegmentS, t.segment_s, t.num_waypoints);
+    MAP_FILE_SECTION(MapFileHeader::kBuckets, t.buckets, t.num_buckets);
+    MAP_FILE_SECTION(MapFileHeader::kIndexPoints, t.index_points, t.num_waypoints);
+    MAP_FILE_SECTION(MapFileHeader::kIndexCells, t.index_cells, t.num_index_cells);
+    MAP_FILE_SECTION(MapFileHeader::kIndexItems, t.index_items, t.num_index_items);
+#undef MAP_FILE_SECTION
+    h.file_size = offset;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return fail(error, "cannot create " + path);
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    uint64_t pos = sizeof(h);
+    static const char zeros[kAlignment] = {0};
+    for (int k = 0; k < MapFileHeader::kNumSections; k++) {
+      out.write(zeros, h.sections[k].offset - pos);
+      uint64_t bytes = elem_size[k] * h.sections[k].count;
+      out.write(static_cast<const char *>(data[k]), bytes);
+      pos = h.sections[k].offset + bytes;
+    }
+    out.write(zeros, h.file_size - pos);
+    if (!out) return fail(error, "error writing " + path);
+    return true;
+  }
+
+  // Builds the road map tables for wp and writes them to path as a C++
+  // header of constexpr arrays, with an embeddedMapTables() function
+  // returning them as MapTables. The arrays are only the data: lookups go
+  // through RoadMap on MapTables, with run-time sizes, as for a mapped file.
+  static bool writeHeader(const std::string &path, const MapWaypoints &wp,
+                          double max_s, const std::string &source,
+                          std::string *error = 0) {
+    if (wp.size() < 2) return fail(error, "a map needs at least two waypoints");
+    RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+    std::vector<MapFileWaypoint> waypoints;
+    MapTables t = tablesOf(road_map, wp, &waypoints);
+
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    if (!out) return fail(error, "cannot create " + path);
+    out.precision(17);
+    out << "// Generated by map_compiler from " << source << ". Do not edit.\n"
+        << "#ifndef EMBEDDED_MAP_DATA_H\n#define EMBEDDED_MAP_DATA_H\n\n"
+        << "#include \"map_file.h\"\n\nnamespace embedded_map {\n\n";
+
+    out << "constexpr MapFileWaypoint kWaypoints[] = {\n";
+    for (size_t i = 0; i < t.num_waypoints; i++) {
+      const MapFileWaypoint &w = t.waypoints[i];
+      out << "  {" << w.x << ", " << w.y << ", " << w.s << ", " << w.dx << ", "
+          << w.dy << "},\n";
+    }
+    out << "};\n\nconstexpr RoadSegment kSegments[] = {\n";
+    for (size_t i = 0; i < t.num_waypoints; i++) {
+      const RoadSegment &g = t.segments[i];
+      out << "  {" << g.x << ", " << g.y << ", " << g.s << ", " << g.length
+          << ", " << g.tx << ", " << g.ty << ", " << g.nx << ", " << g.ny
+          << "},\n";
+    }
+    out << "};\n\nconstexpr double kSegmentS[] = {\n";
+    for (size_t i = 0; i < t.num_waypoints; i++) {
+      out << "  " << t.segment_s[i] << ",\n";
+    }
+    out << "};\n\nconstexpr int kBuckets[] = {\n";
+    for (size_t i = 0; i < t.num_buckets; i++) {
+      out << "  " << t.buckets[i] << ",\n";
+    }
+    out << "};\n\nconstexpr WaypointIndex::Point kIndexPoints[] = {\n";
+    for (size_t i = 0; i < t.num_waypoints; i++) {
+      out << "  {" << t.index_points[i].x << ", " << t.index_points[i].y << "},\n";
+    }
+    out << "};\n\nconstexpr WaypointIndex::Cell kIndexCells[] = {\n";
+    for (size_t i = 0; i < t.num_index_cells; i++) {
+      const WaypointIndex::Cell &c = t.index_cells[i];
+      out << "  {" << c.cx << ", " << c.cy << ", " << c.begin << ", " << c.end
+          << "},\n";
+    }
+    out << "};\n\nconstexpr WaypointIndex::Segment kIndexItems[] = {\n";
+    for (size_t i = 0; i < t.num_index_items; i++) {
+      const WaypointIndex::Segment &g = t.index_items[i];
+      out << "  {" << g.ax << ", " << g.ay << ", " << g.bx << ", " << g.by
+          << ", " << g.i << ", " << g.j << "},\n";
+    }
+    out << "};\n\n"
+        << "inline MapTables embeddedMapTables() {\n"
+        << "  MapTables t = {\n"
+        << "      " << t.max_s << ", " << t.bucket_inv_width << ",\n"
+        << "      " << t.index_min_x << ", " << t.index_min_y << ", "
+        << t.index_cell << ",\n"
+        << "      " << t.index_gx_max << ", " << t.index_gy_max << ", "
+        << t.index_num_segments << ", " << t.index_table_mask << "u,\n"
+        << "      " << t.num_waypoints << ", " << t.num_buckets << ", "
+        << t.num_index_cells << ", " << t.num_index_items << ",\n"
+        << "      kWaypoints, kSegments, kSegmentS, kBuckets,\n"
+        << "      kIndexPoints, kIndexCells, kIndexItems};\n"
+        << "  return t;\n}\n\n"
+        << "}  // namespace embedded_map\n\n#endif  // EMBEDDED_MAP_DATA_H\n";
+    if (!out) return fail(error, "error writing " + path);
+    return true;
+  }
+
+ private:
+  // Only the tables' binary layout is stored, so it must not change
+  // without bumping kVersion.
+  static_assert(sizeof(MapFileHeader) == 192, "MapFileHeader layout");
+  static_assert(sizeof(MapFileWaypoint) == 40, "MapFileWaypoint layout");
+  static_assert(sizeof(RoadSegment) == 64, "RoadSegment layout");
+  static_assert(sizeof(WaypointIndex::Point) == 16, "Point layout");
+  static_assert(sizeof(WaypointIndex::Cell) == 16, "Cell layout");
+  static_assert(sizeof(WaypointIndex::Segment) == 40, "Segment layout");
+
+  MapFile(const MapFile &);
+  MapFile &operator=(const MapFile &);
+
+  static const char *kMagic() { return "PPMAP\0\0\0"; }
+  static uint64_t align(uint64_t n) {
+    return (n + kAlignment - 1) / kAlignment * kAlignment;
+  }
+  static bool hostIsLittleEndian() {
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t *>(&one) == 1;
+  }
+  static bool fail(std::string *error, const std::string &why) {
+    if (error) *error = why;
+    return false;
+  }
+
+  // The tables of a freshly built road_map; waypoints receives the
+  // waypoint records for wp.
+  static MapTables tablesOf(const RoadMap &road_map, const MapWaypoints &wp,
+                            std::vector<MapFileWaypoint> *waypoints) {
+    waypoints->resize(wp.size());
+    for (size_t i = 0; i < wp.size(); i++) {
+      MapFileWaypoint w = {wp.x[i], wp.y[i], wp.s[i], wp.dx[i], wp.dy[i]};
+      (*waypoints)[i] = w;
+    }
+    const WaypointIndex &index = road_map.index_;
+    MapTables t;
+    t.max_s = road_map.max_s_;
+    t.bucket_inv_width = road_map.bucket_inv_width_;
+    t.index_min_x = index.min_x_;
+    t.index_min_y = index.min_y_;
+    t.index_cell = index.cell_;
+    t.index_gx_max = index.gx_max_;
+    t.index_gy_max = index.gy_max_;
+    t.index_num_segments = index.num_segments_;
+    t.index_table_mask = index.table_mask_;
+    t.num_waypoints = wp.size();
+    t.num_buckets = road_map.bucket_.size();
+    t.num_index_cells = index.table_.size();
+    t.num_index_items = index.cell_items_.size();
+    t.waypoints = &(*waypoints)[0];
+    t.segments = road_map.segments_.data();
+    t.segment_s = road_map.seg_s_.data();
+    t.buckets = road_map.bucket_.data();
+    t.index_points = index.pts_.data();
+    t.index_cells = index.table_.data();
+    t.index_items = index.cell_items_.data();
+    return t;
+  }
+
+  template <class T>
+  const T *section(int id) const {
+    const MapFileHeader &h = *reinterpret_cast<const MapFileHeader *>(base_);
+    return reinterpret_cast<const T *>(base_ + h.sections[id].offset);
+  }
+
+  // Checks the header and points road_map_ at the mapped tables.
+  bool attach(std::string *why) {
+    const MapFileHeader &h = *reinterpret_cast<const MapFileHeader *>(base_);
+    if (memcmp(h.magic, kMagic(), sizeof(h.magic)) != 0) {
+      *why = "not a map file";
+      return false;
+    }
+    if (h.version != kVersion || h.header_size != sizeof(MapFileHeader)) {
+      *why = "unsupported map file version";
+      return false;
+    }
+    if (h.file_size != size_) {
+      *why = "truncated map file";
+      return false;
+    }
+    static const uint64_t elem_size[MapFileHeader::kNumSections] = {
+        sizeof(MapFileWaypoint),      sizeof(RoadSegment),
+        sizeof(double),               sizeof(int32_t),
+        sizeof(WaypointIndex::Point), sizeof(WaypointIndex::Cell),
+        sizeof(WaypointIndex::Segment)};
+    for (int k = 0; k < MapFileHeader::kNumSections; k++) {
+      const MapFileSection &sec = h.sections[k];
+      if (sec.offset % kAlignment != 0 || sec.offset > size_ ||
+          sec.count > (size_ - sec.offset) / elem_size[k]) {
+        *why = "corrupt section table";
+        return false;
+      }
+    }
+    uint64_t n = h.sections[MapFileHeader::kWaypoints].count;
+    uint64_t table_size = h.sections[MapFileHeader::kIndexCells].count;
+    if (n < 2 || h.sections[MapFileHeader::kSegments].count != n ||
+        h.sections[MapFileHeader::kSegmentS].count != n ||
+        h.sections[MapFileHeader::kIndexPoints].count != n ||
+        h.sections[MapFileHeader::kBuckets].count < 2 ||
+        table_size != uint64_t(h.index_table_mask) + 1) {
+      *why = "inconsistent section sizes";
+      return false;
+    }
+
+    MapTables &t = tables_;
+    t.max_s = h.max_s;
+    t.bucket_inv_width = h.bucket_inv_width;
+    t.index_min_x = h.index_min_x;
+    t.index_min_y = h.index_min_y;
+    t.index_cell = h.index_cell;
+    t.index_gx_max = h.index_gx_max;
+    t.index_gy_max = h.index_gy_max;
+    t.index_num_segments = h.index_num_segments;
+    t.index_table_mask = h.index_table_mask;
+    t.num_waypoints = n;
+    t.num_buckets = h.sections[MapFileHeader::kBuckets].count;
+    t.num_index_cells = table_size;
+    t.num_index_items = h.sections[MapFileHeader::kIndexItems].count;
+    t.waypoints = section<MapFileWaypoint>(MapFileHeader::kWaypoints);
+    t.segments = section<RoadSegment>(MapFileHeader::kSegments);
+    t.segment_s = section<double>(MapFileHeader::kSegmentS);
+    t.buckets = section<int>(MapFileHeader::kBuckets);
+    t.index_points = section<WaypointIndex::Point>(MapFileHeader::kIndexPoints);
+    t.index_cells = section<WaypointIndex::Cell>(MapFileHeader::kIndexCells);
+    t.index_items = section<WaypointIndex::Segment>(MapFileHeader::kIndexItems);
+    if (!checkTables(t, why)) return false;
+    attachTables(t, &road_map_);
+    return true;
+  }
+
+  // Checks that every index stored in the tables stays within the table it
+  // points into, so that lookups on a corrupt file cannot read out of
+  // bounds. Section sizes are already known to agree.
+  static bool checkTables(const MapTables &t, std::string *why) {
+    const size_t n = t.num_waypoints;
+    if (!(t.max_s > 0 && t.max_s < HUGE_VAL) ||
+        !(t.bucket_inv_width > 0 &&
+          t.bucket_inv_width * t.max_s <= double(t.num_buckets))) {
+      *why = "corrupt s buckets";
+      return false;
+    }
+    // segmentAtS() scans or searches segments [buckets[b], buckets[b + 1]]
+    for (size_t b = 0; b < t.num_buckets; b++) {
+      int seg = t.buckets[b];
+      if (seg < 0 || size_t(seg) >= n || (b > 0 && seg < t.buckets[b - 1])) {
+        *why = "corrupt s buckets";
+        return false;
+      }
+    }
+    if (!(t.index_cell > 0 && t.index_cell < HUGE_VAL) || t.index_gx_max < 0 ||
+        t.index_gy_max < 0 || t.index_num_segments < 0 ||
+        size_t(t.index_num_segments) > n ||
+        (t.num_index_cells & t.index_table_mask) != 0) {
+      *why = "corrupt index header";
+      return false;
+    }
+    for (size_t k = 0; k < t.num_index_cells; k++) {
+      const WaypointIndex::Cell &c = t.index_cells[k];
+      if (c.begin >= 0 && (c.end < c.begin || size_t(c.end) > t.num_index_items)) {
+        *why = "corrupt index cell";
+        return false;
+      }
+    }
+    // Items are segments when the index has any, else single points.
+    size_t num_i = t.index_num_segments > 0 ? size_t(t.index_num_segments) : n;
+    for (size_t k = 0; k < t.num_index_items; k++) {
+      const WaypointIndex::Segment &g = t.index_items[k];
+      if (g.i < 0 || size_t(g.i) >= num_i || g.j < 0 || size_t(g.j) >= n) {
+        *why = "corrupt index item";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char *base_;
+  uint64_t size_;
+  MapTables tables_;
+  RoadMap road_map_;
+};
+
+#endif  // MAP_FILE_H
@@ -0,0 +1,406 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "async_logger.h"
+#include "helpers.h"
+#include "json.hpp"
+#include "planner_map.h"
+#include "planner_metrics.h"
+#include "socket_io.h"
+#include "spline.h"
+#include "telemetry_frame.h"
+#include "traffic_snapshot.h"
+
+//>> pparthas: Some constants used for path planning
+#define LNWDTH 4.0          // given lane width = 4 meters
+#define TIMESTEP 0.02       // time steps are for every 20 ms
+#define SAFEGAP 30          // Safe trailing gap from preceeding car
+#define PASSGAP 20          // Safe gap for passing safely
+#define SAFE_ACC_STEP 0.224 // Safe speed change (acceleration/deceleration) in TIMESTEP to not exceed Jerk Limits (5 meters/sec-squared)
+#define SPEEDLMT 49.5       // Speed limit set slightly lower than actual speed limit of 50 mph
+#define MPH_2_mps 2.24      // Constant to convert from MPH to meters per second
+//<< pparthas
+
+// The path planner behind the simulator's websocket: handle() takes one
+// message and produces the reply to send back. It does no I/O itself, so
+// path_planning runs it on uWS's event loop and planner_replay on captured
+// messages.
+//
+// Keeps the lane and reference velocity from frame to frame, so one
+// Planner follows one simulator session.
+//
+// In the unnamed namespace like PlannerMap, which it points to.
+namespace {
+
+class Planner {
+ public:
+  enum Reply {
+    kNoReply,
+    kPong,     // "3", the answer to an Engine.IO ping
+    kManual,   // the car is in manual mode
+    kControl   // the next path
+  };
+
+  // The telemetry frame starts out with room for max_cars cars and grows,
+  // up to TelemetryFrame::kMaxSyntheticCars, when a message has more.
+  Planner(PlannerMap *map, AsyncLogger *logger, PlannerMetrics *metrics,
+          int max_cars = TelemetryFrame::kMaxCars)
+      : map_(map), logger_(logger), metrics_(metrics), telemetry_(max_cars), lane_(1),
+        ref_vel_(0.0) {}
+
+  // Handles a message that arrived at `start` (PlannerMetrics::now()),
+  // leaving the reply, if any, in *reply. Records the metrics of every
+  // stage up to and including serialization.
+  Reply handle(const char *data, size_t length, uint64_t start, std::string *reply) {
+    PlannerMetrics &metrics = *metrics_;
+    // "42" at the start of the message means there's a websocket message event.
+    // The 4 signifies a websocket message
+    // The 2 signifies a websocket event
+    // The frame and the telemetry decoder both read the message buffer in
+    // place.
+    SocketIoFrame frame = parseSocketIoFrame(data, length);
+    uint64_t t = metrics.lap(PlannerMetrics::kFrameParse, start);
+    if (frame.kind == SocketIoFrame::kPing) {
+      reply->assign("3");
+      return kPong;
+    } else if (frame.kind == SocketIoFrame::kEvent) {
+      if (frame.hasData()) {
+        // Only telemetry events are decoded; the event's data object goes
+        // straight into the telemetry frame
+        if (decodeTelemetry(frame.payload, frame.payload + frame.payload_length, &telemetry_)) {
+          if (telemetry_.truncated) decodeTruncated(frame);
+          plan(metrics.lap(PlannerMetrics::kJsonDecode, t), reply);
+          return kControl;
+        }
+      } else {
+        // Manual driving
+        reply->assign("42[\"manual\",{}]");
+        return kManual;
+      }
+    }
+    return kNoReply;
+  }
+
+  int lane() const { return lane_; }
+  double refVel() const { return ref_vel_; }
+
+ private:
+  // The message had more cars or path points than telemetry_ holds. Grows
+  // the sensor fusion table to fit every car, up to kMaxSyntheticCars, and
+  // decodes the message again; the table keeps its new size. What still
+  // does not fit is left out of planning, and the frame counted and logged.
+  void decodeTruncated(const SocketIoFrame &frame) {
+    int cars = telemetry_.sensor_fusion.size() + telemetry_.dropped_cars;
+    int capacity = telemetry_.sensor_fusion.capacity();
+    if (telemetry_.dropped_cars > 0 && capacity < TelemetryFrame::kMaxSyntheticCars) {
+      telemetry_.sensor_fusion.reserve(
+          std::min(std::max(cars, 2 * capacity), int(TelemetryFrame::kMaxSyntheticCars)));
+      decodeTelemetry(frame.payload, frame.payload + frame.payload_length, &telemetry_);
+    }
+    if (telemetry_.truncated) {
+      metrics_->countTruncatedFrame();
+      LOG_WARN(*logger_, "Telemetry truncated: planning on {} of {} cars, {} path points",
+               telemetry_.sensor_fusion.size(), cars, telemetry_.previous_path_x.size());
+    }
+  }
+
+  // The lane change decision's questions about the other cars, answered by
+  // scanning the sensor fusion columns as main.cpp did. Indexing the cars
+  // (LaneOccupancy) takes a pass over every car's projected s and lane,
+  // more than the few scans per frame it saves at any number of cars
+  // (lane_bench).
+
+  static bool inLane(double d, int lane) { return (d > lane * LNWDTH) && (d < (lane + 1) * LNWDTH); }
+
+  // Number of cars in Ego car's lane ahead of car_s by less than SAFEGAP,
+  // and the projected s of the nearest of them.
+  int tooCloseCars(const TrafficSnapshot &traffic, double horizon, double car_s,
+                   double *nearest_s) const {
+    int count = 0, n = traffic.size();
+    double left = lane_ * LNWDTH, right = left + LNWDTH;
+    for (int i = 0; i < n; i++) {
+      double d = traffic.d(i);
+      if (!((d > left) && (d < right))) continue;  // not in Ego car's lane
+      double check_car_s = traffic.projectS(i, horizon);
+      if ((check_car_s > car_s) && ((check_car_s - car_s) < SAFEGAP)) {
+        if (count++ == 0 || check_car_s < *nearest_s) *nearest_s = check_car_s;
+      }
+    }
+    return count;
+  }
+
+  // A car of each of the 3 lanes with lo < s < hi, -1 for a lane with none,
+  // in one pass.
+  void carsWithin(const TrafficSnapshot &traffic, double lo, double hi, int *blocking) const {
+    blocking[0] = blocking[1] = blocking[2] = -1;
+    for (int i = 0; i < traffic.size(); i++) {
+      double s = traffic.s(i);
+      if ((s <= lo) || (s >= hi)) continue;
+      for (int lane = 0; lane < 3; lane++) {
+        if (inLane(traffic.d(i), lane)) blocking[lane] = i;
+      }
+    }
+  }
+
+  // Plans the next path from the telemetry in telemetry_, starting the
+  // behavior stage at t.
+  void plan(uint64_t t, std::string *reply) {
+    PlannerMetrics &metrics = *metrics_;
+    // Main car's localization data
+    double car_x = telemetry_.x;
+    double car_y = telemetry_.y;
+    double car_s = telemetry_.s;
+    map_->prefetch(car_s);
+    double car_yaw = telemetry_.yaw;
+
+    // Previous path data given to the planner
+    const auto &previous_path_x = telemetry_.previous_path_x;
+    const auto &previous_path_y = telemetry_.previous_path_y;
+
+    // Sensor fusion data, a list of all other cars on the same side of the road,
+    // decoded straight into columns
+    const TrafficSnapshot &traffic = telemetry_.sensor_fusion;
+
+    //>>pparthas: START of Path Planning
+    // Start with 2 "starting" reference points using previous or current car position
+    // Add 3 more widely spaced (x,y) waypoints, evenly spaced at 30m
+    // Interpolate these 5 waypoints with a spline to determine trajectory
+
+    // determine number of points in previous path from simulator
+    int prev_size = previous_path_x.size();
+    if (prev_size > 0) {
+      car_s = telemetry_.end_path_s;  // if we have previous data, let's start trajectory from it's last location
+    }
+
+    // control variables based on predictions of speed and position of other cars from sensor fusion
+    bool too_close = false;
+    bool leftlanechange = true;
+    bool rightlanechange = true;
+
+    // Cars ahead of Ego car in its lane by less than SAFEGAP (30 meters), with their s
+    // projected out to the end of the previous path (if using previous data), and the
+    // nearest
+    double ahead_s;
+    int too_close_cars = tooCloseCars(traffic, prev_size * TIMESTEP, car_s, &ahead_s);
+    if (too_close_cars > 0) {
+      // We are too close to preceeding car and need to take some action
+      LOG_INFO(*logger_, "TOO CLOSE: Car ahead @ s = {}, Ego @ s = {}", ahead_s, car_s);
+
+      too_close = true;
+      // Do lane changes if safe to do so: a lane is blocked by any car within PASSGAP of Ego car.
+      // The checks run once per car too close, and the lane change flags, once cleared, stay
+      // cleared, so a later run can change lanes again; once a run changes nothing, neither
+      // do the rest.
+      int blocking[3];
+      carsWithin(traffic, car_s - PASSGAP, car_s + PASSGAP, blocking);
+      for (int run = 0; run < too_close_cars; run++) {
+        int last_lane = lane_;
+        bool last_left = leftlanechange, last_right = rightlanechange;
+        // If Ego car is in center lane
+        if (lane_ == 1) {  // consider shifting to right or left lanes
+          if (blocking[0] >= 0) {  // car in left lane
+            LOG_DEBUG(*logger_, "Left check_car_s = {}", traffic.s(blocking[0]));
+            LOG_DEBUG(*logger_, " car {} too close to change lane", blocking[0]);
+            leftlanechange = false;
+          }
+          if (blocking[2] >= 0) {  // car in right lane
+            LOG_DEBUG(*logger_, "Right check_car_s = {}", traffic.s(blocking[2]));
+            LOG_DEBUG(*logger_, " car {} too close to change lane", blocking[2]);
+            rightlanechange = false;
+          }
+          LOG_DEBUG(*logger_, "leftlanechange = {}", leftlanechange);
+          LOG_DEBUG(*logger_, "rightlanechange = {}", rightlanechange);
+          // Change lane variable used in determining spline trajectory's 3 new 30 meter spaced waypoints
+          if (leftlanechange) {
+            lane_ = 0;  // shift to left lane.
+          }
+          if (rightlanechange) {
+            lane_ = 2;  // shift to right lane.
+          }
+        }  // END of checking If Ego car is in center lane
+        // If Ego car is in left lane
+        if (lane_ == 0) {  // consider shifting to center lane
+          if (blocking[1] >= 0) {  // car in center lane
+            LOG_DEBUG(*logger_, "Center check_car_s = {}", traffic.s(blocking[1]));
+            LOG_DEBUG(*logger_, " car {} too close to change lane", blocking[1]);
+            rightlanechange = false;
+          }
+          LOG_DEBUG(*logger_, "rightlanechange = {}", rightlanechange);
+          if (rightlanechange) {
+            lane_ = 1;  // shift to center lane.
+          }
+        }  // END of checking If Ego car is in left lane
+        // If Ego Car is in right lane
+        if (lane_ == 2) {  // consider shifting to center lane
+          if (blocking[1] >= 0) {  // car in center lane
+            LOG_DEBUG(*logger_, "Center check_car_s = {}", traffic.s(blocking[1]));
+            LOG_DEBUG(*logger_, " car {} too close to change lane", blocking[1]);
+            leftlanechange = false;
+          }
+          LOG_DEBUG(*logger_, "leftlanechange = {}", leftlanechange);
+          if (leftlanechange) {
+            lane_ = 1;  // shift to center lane.
+          }
+        }  // END of checking If Ego car is in right lane
+        if (lane_ == last_lane && leftlanechange == last_left && rightlanechange == last_right) break;
+      }
+    }  // END of checking if gap to preceeding car is less than SAFEGAP (30 meters)
+
+    // Speed control
+    if (too_close) {  // If too close to preceeding car
+      ref_vel_ -= SAFE_ACC_STEP;  // Decelerate gradually to not exceed Jerk Limits 5 m/s^2
+    } else if (ref_vel_ < SPEEDLMT) {  // If below speed limit
+      ref_vel_ += SAFE_ACC_STEP;  // Accelerate gradually to not exceed Jerk Limits 5 m/s^2
+    }
+
+    t = metrics.lap(PlannerMetrics::kBehavior, t);
+
+    // Create list of widely spaced (x,y) anchors or way points, evenly spaced at SAFEGAP (30 m)
+    // We will interpolate these with a spline to create the desired trajectory
+    // and later we will fill it in with more points that control speed
+    std::vector<double> ptsx;
+    std::vector<double> ptsy;
+
+    // First create 2 starting reference points by using previous points (if there are enough of them)
+    // or use the car's current x,y & yaw
+    double ref_x = car_x;
+    double ref_y = car_y;
+    double ref_yaw = deg2rad(car_yaw);
+    // if the previous size is almost empty, use the car's current x,y & yaw as reference
+    if (prev_size < 2) {
+      // Creating another point that is backwards in time compared to where the car is at
+      double prev_car_x = car_x - cos(ref_yaw);
+      double prev_car_y = car_y - sin(ref_yaw);
+
+      ptsx.push_back(prev_car_x);
+      ptsx.push_back(ref_x);
+
+      ptsy.push_back(prev_car_y);
+      ptsy.push_back(ref_y);
+    } else {  // use car's previous end point as reference
+      // redefine ref as prev path end points
+      ref_x = previous_path_x[prev_size - 1];
+      ref_y = previous_path_y[prev_size - 1];
+
+      double prev_ref_x = previous_path_x[prev_size - 2];
+      double prev_ref_y = previous_path_y[prev_size - 2];
+      ref_yaw = atan2(ref_y - prev_ref_y, ref_x - prev_ref_x);
+
+      // Use two points that make the path tangent to the prev path's end point
+      ptsx.push_back(prev_ref_x);
+      ptsx.push_back(ref_x);
+
+      ptsy.push_back(prev_ref_y);
+      ptsy.push_back(ref_y);
+    }
+
+    // So far we have 2 points based on starting reference
+    // In Frenet, add 3 more points spaced evenly 30 m ahead of the starting reference
+    auto next_wp0 = map_->getXY(car_s + 30, (2 + 4 * lane_));
+    auto next_wp1 = map_->getXY(car_s + 60, (2 + 4 * lane_));
+    auto next_wp2 = map_->getXY(car_s + 90, (2 + 4 * lane_));
+
+    ptsx.push_back(next_wp0[0]);
+    ptsx.push_back(next_wp1[0]);
+    ptsx.push_back(next_wp2[0]);
+
+    ptsy.push_back(next_wp0[1]);
+    ptsy.push_back(next_wp1[1]);
+    ptsy.push_back(next_wp2[1]);
+
+    // Transforming from global map coordinates to car's local coordinates
+    // With this, the last point would be at x=0,y=0, and at 0 degrees angle
+    for (size_t i = 0; i < ptsx.size(); i++) {
+      // shift car ref angle to 0 deg
+      double shift_x = ptsx[i] - ref_x;
+      double shift_y = ptsy[i] - ref_y;
+
+      ptsx[i] = (shift_x * cos(0 - ref_yaw) - shift_y * sin(0 - ref_yaw));
+      ptsy[i] = (shift_x * sin(0 - ref_yaw) + shift_y * cos(0 - ref_yaw));
+    }
+
+    // Create a spline through the 5 points, without heap allocations
+    tk::fixed_spline<5> s;
+
+    // set (x,y) points to the spline. i.e. add x,y points to the spline
+    {
+      TRACE_SPAN("tk::fixed_spline::set_points");
+      s.set_points(ptsx, ptsy);
+    }
+    t = metrics.lap(PlannerMetrics::kSplineFit, t);
+
+    // Define the actual (x,y) points that we will use for the path planner
+    std::vector<double> next_x_vals;
+    std::vector<double> next_y_vals;
+
+    // Start with all of the previous path points from last time
+    for (int i = 0; i < prev_size; ++i) {
+      next_x_vals.push_back(previous_path_x[i]);
+      next_y_vals.push_back(previous_path_y[i]);
+    }
+    // Calculate how to break up spline points such that we travel at the desired reference velocity
+    // This is from Aaron's "visual aid" from the project walk through video
+    double target_x = 30.0;  // Pick a distance (along x-axis or angle 0 in local car coordinates), say 30 m
+    double target_y = s(target_x);  // Corresponding y is obtained from the spline function
+    // Distance along car's path is hypotenuse of triangle with target_x as base, target_y as height
+    double target_dist = sqrt((target_x) * (target_x) + (target_y) * (target_y));
+
+    double x_add_on = 0;  // Starting value of x
+
+    // Fill up rest of our path planner after filling it up with prev path points
+    // here we choose to use 50 points in our path planner controls
+    for (int i = 1; i <= 50 - prev_size; i++) {
+      double N = (target_dist / (TIMESTEP * ref_vel_ / MPH_2_mps));
+      double x_point = x_add_on + (target_dist / N);
+      double y_point = s(x_point);
+
+      x_add_on = x_point;  // Update starting value of x
+
+      double x_ref = x_point;
+      double y_ref = y_point;
+
+      // rotate back to normal after rotating it earlier
+      // transform from local coordinates back to global cordinates
+      x_point = (x_ref * cos(ref_yaw) - y_ref * sin(ref_yaw));
+      y_point = (x_ref * sin(ref_yaw) + y_ref * cos(ref_yaw));
+
+      // add back car's starting position
+      x_point += ref_x;
+      y_point += ref_y;
+
+      // add to path planner control points
+      next_x_vals.push_back(x_point);
+      next_y_vals.push_back(y_point);
+    }
+    //<<pparthas: END of Path planning
+    t = metrics.lap(PlannerMetrics::kPointGeneration, t);
+    nlohmann::json msgJson;
+
+    msgJson["next_x"] = next_x_vals;
+    msgJson["next_y"] = next_y_vals;
+
+    *reply = "42[\"control\"," + msgJson.dump() + "]";
+    metrics.lap(PlannerMetrics::kSerialization, t);
+  }
+
+  PlannerMap *map_;
+  AsyncLogger *logger_;
+  PlannerMetrics *metrics_;
+  // Telemetry of the latest message, refilled in place every frame
+  TelemetryFrame telemetry_;
+  //>>pparthas: lane position and reference velocity
+  //start in lane 1
+  int lane_;
+  //start with reference velocity of 0 mph
+  double ref_vel_;
+  //<<pparthas
+};
+
+}  // namespace
+
+#endif  // PLANNER_H
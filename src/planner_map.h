@@ -0,0 +1,107 @@
+#ifndef PLANNER_MAP_H
+#define PLANNER_MAP_H
+
+#include <array>
+#include <string>
+#include "map_file.h"
+#include "road_map.h"
+#include "span_tracer.h"
+#include "spline_road_map.h"
+#include "tiled_road_map.h"
+
+// The road map the planner places its trajectory anchors on: a CSV map, a
+// binary or tiled map made from it with map_compiler, or tables compiled
+// into the executable; optionally spline-fitted. Shared by path_planning
+// and planner_replay so that both plan on exactly the same road.
+//
+// In the unnamed namespace like SplineRoadMap, which it holds by value.
+namespace {
+
+class PlannerMap {
+ public:
+  PlannerMap() : use_spline_map_(false), max_s_(6945.554) {}
+
+  // Reads a CSV, binary or tiled map. With use_spline_map the anchors are
+  // placed on a road fitted with cubic splines through the waypoints, which
+  // a tiled map cannot provide.
+  bool load(const std::string &path, bool use_spline_map, std::string *error) {
+    use_spline_map_ = use_spline_map;
+    MapWaypoints waypoints;
+    if (TiledRoadMap::isTileFile(path)) {
+      // Tiles are read as the car gets to them, so the spline fit, which
+      // needs all waypoints up front, is not available
+      if (use_spline_map) {
+        *error = "--spline-map needs a CSV or binary map";
+        return false;
+      }
+      return tiled_map_.open(path, error);
+    } else if (MapFile::isMapFile(path)) {
+      if (!map_bin_.open(path, error)) return false;
+      max_s_ = map_bin_.roadMap().maxS();
+      if (use_spline_map) map_bin_.waypoints(&waypoints);
+    } else {
+      if (!readMapCsv(path, &waypoints)) {
+        *error = "Failed to read " + path;
+        return false;
+      }
+      loaded_road_map_.build(waypoints.x, waypoints.y, waypoints.s, waypoints.dx,
+                             waypoints.dy, max_s_);
+    }
+    if (use_spline_map) fitSpline(waypoints);
+    return true;
+  }
+
+  // Uses waypoints already in memory, e.g. a synthetic loop.
+  void build(const MapWaypoints &wp, double max_s, bool use_spline_map) {
+    use_spline_map_ = use_spline_map;
+    max_s_ = max_s;
+    loaded_road_map_.build(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s_);
+    if (use_spline_map) fitSpline(wp);
+  }
+
+  // Uses tables that outlive the map, e.g. the embedded map.
+  void attach(const MapTables &tables, bool use_spline_map) {
+    use_spline_map_ = use_spline_map;
+    MapFile::attachTables(tables, &loaded_road_map_);
+    max_s_ = tables.max_s;
+    if (use_spline_map) {
+      MapWaypoints waypoints;
+      MapFile::waypoints(tables, &waypoints);
+      fitSpline(waypoints);
+    }
+  }
+
+  // Road coordinates to x,y on whichever map was loaded
+  std::array<double, 2> getXY(double s, double d) {
+    TRACE_SPAN("getXY");
+    if (tiled_map_.isOpen()) return tiled_map_.getXY(s, d);
+    return use_spline_map_ ? spline_map_.getXY(s, d) : roadMap().getXY(s, d);
+  }
+
+  // Tells a tiled map where the car is, so that it reads the tiles ahead in
+  // the background.
+  void prefetch(double s) {
+    if (tiled_map_.isOpen()) tiled_map_.prefetch(s);
+  }
+
+ private:
+  const RoadMap &roadMap() const {
+    return map_bin_.isOpen() ? map_bin_.roadMap() : loaded_road_map_;
+  }
+
+  void fitSpline(const MapWaypoints &wp) {
+    spline_map_.build(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s_);
+  }
+
+  bool use_spline_map_;
+  // The max s value before wrapping around the track back to 0
+  double max_s_;
+  MapFile map_bin_;
+  TiledRoadMap tiled_map_;
+  RoadMap loaded_road_map_;
+  SplineRoadMap spline_map_;
+};
+
+}  // namespace
+
+#endif  // PLANNER_MAP_H
@@ -0,0 +1,150 @@
+#ifndef PLANNER_METRICS_H
+#define PLANNER_METRICS_H
+
+#include <stdint.h>
+#include <sstream>
+#include <string>
+#include "latency_histogram.h"
+#include "span_tracer.h"
+
+// Latency of each stage of handling a simulator message, plus the whole
+// message, served in the Prometheus text format.
+//
+// A stage is timed by chaining lap() calls on the event loop thread:
+//
+//   uint64_t start = metrics.now();
+//   ...parse the frame...
+//   uint64_t t = metrics.lap(PlannerMetrics::kFrameParse, start);
+//   ...decode the JSON...
+//   t = metrics.lap(PlannerMetrics::kJsonDecode, t);
+//
+// Each lap is one clock read plus LatencyHistogram::record(), and is also
+// recorded as a SpanTracer span if the thread is registered with it. Not
+// thread safe: record and serve from the same thread, as uWS's handlers
+// are.
+class PlannerMetrics {
+ public:
+  enum Stage {
+    kFrameParse,
+    kJsonDecode,
+    kBehavior,
+    kSplineFit,
+    kPointGeneration,
+    kSerialization,
+    kSend,
+    kEndToEnd,
+    kNumStages
+  };
+
+  PlannerMetrics() : truncated_frames_(0), current_second_(0) {
+    for (uint64_t &n : second_counts_) n = 0;
+  }
+
+  static uint64_t now() { return SpanTracer::now(); }
+
+  // Records the time from `since` to now for stage and returns now, to
+  // start the next stage from.
+  uint64_t lap(Stage stage, uint64_t since) {
+    uint64_t t = now();
+    stages_[stage].record(t - since);
+    SpanTracer::instance().record(stageName(stage), since, t);
+    if (stage == kEndToEnd) countMessage(t);
+    return t;
+  }
+
+  const LatencyHistogram &stage(Stage stage) const { return stages_[stage]; }
+  void merge(const PlannerMetrics &o) {
+    for (int i = 0; i < kNumStages; i++) stages_[i].merge(o.stages_[i]);
+    truncated_frames_ += o.truncated_frames_;
+  }
+
+  // Telemetry messages planned on part of their data because it did not
+  // fit in the planner's TelemetryFrame.
+  void countTruncatedFrame() { truncated_frames_++; }
+  uint64_t truncatedFrames() const { return truncated_frames_; }
+
+  static const char *stageName(Stage stage) {
+    static const char *names[] = {"frame_parse",      "json_decode",   "behavior",
+                                  "spline_fit",       "point_generation",
+                                  "serialization",    "send",          "end_to_end"};
+    return names[stage];
+  }
+
+  // Messages per second over the last kRateSeconds whole seconds.
+  double messageRate() const {
+    uint64_t second = now() / 1000000000;
+    uint64_t messages = 0;
+    for (uint64_t s = second - kRateSeconds; s < second; s++) {
+      // Slots hold the kRateSeconds + 1 seconds up to current_second_
+      if (s <= current_second_ && s + kRateSeconds >= current_second_) {
+        messages += second_counts_[s % (kRateSeconds + 1)];
+      }
+    }
+    return double(messages) / kRateSeconds;
+  }
+
+  // All stages as a Prometheus summary in seconds, with the largest value
+  // seen, the message count and messageRate(). Only reads the metrics, so
+  // any number of scrapers see the same values.
+  std::string prometheus() const {
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::ostringstream out;
+    out << "# HELP planner_stage_latency_seconds Time spent in each stage of "
+           "handling a telemetry message.\n"
+        << "# TYPE planner_stage_latency_seconds summary\n";
+    for (int i = 0; i < kNumStages; i++) {
+      const LatencyHistogram &h = stages_[i];
+      const char *name = stageName(Stage(i));
+      for (double q : kQuantiles) {
+        out << "planner_stage_latency_seconds{stage=\"" << name << "\",quantile=\"" << q
+            << "\"} " << h.quantile(q) * 1e-9 << "\n";
+      }
+      out << "planner_stage_latency_seconds_sum{stage=\"" << name << "\"} "
+          << h.sum() * 1e-9 << "\n"
+          << "planner_stage_latency_seconds_count{stage=\"" << name << "\"} "
+          << h.count() << "\n";
+    }
+    out << "# HELP planner_stage_latency_max_seconds Slowest run of each stage.\n"
+        << "# TYPE planner_stage_latency_max_seconds gauge\n";
+    for (int i = 0; i < kNumStages; i++) {
+      out << "planner_stage_latency_max_seconds{stage=\"" << stageName(Stage(i))
+          << "\"} " << stages_[i].max() * 1e-9 << "\n";
+    }
+
+    out << "# HELP planner_messages_total Telemetry messages answered.\n"
+        << "# TYPE planner_messages_total counter\n"
+        << "planner_messages_total " << stages_[kEndToEnd].count() << "\n"
+        << "# HELP planner_messages_per_second Telemetry messages answered per "
+           "second over the last " << kRateSeconds << " seconds.\n"
+        << "# TYPE planner_messages_per_second gauge\n"
+        << "planner_messages_per_second " << messageRate() << "\n"
+        << "# HELP planner_truncated_frames_total Telemetry messages planned without "
+           "the cars or path points that did not fit.\n"
+        << "# TYPE planner_truncated_frames_total counter\n"
+        << "planner_truncated_frames_total " << truncated_frames_ << "\n";
+    return out.str();
+  }
+
+ private:
+  static const int kRateSeconds = 10;
+
+  // Counts a message answered at t in its second's slot, clearing the slots
+  // of the seconds skipped since the previous message.
+  void countMessage(uint64_t t) {
+    uint64_t second = t / 1000000000;
+    if (second != current_second_) {
+      for (int i = 1; i <= kRateSeconds + 1 && current_second_ + i <= second; i++) {
+        second_counts_[(current_second_ + i) % (kRateSeconds + 1)] = 0;
+      }
+      current_second_ = second;
+    }
+    second_counts_[second % (kRateSeconds + 1)]++;
+  }
+
+  LatencyHistogram stages_[kNumStages];
+  uint64_t truncated_frames_;
+  uint64_t second_counts_[kRateSeconds + 1];  // messages per second, ring
+  uint64_t current_second_;                   // second of the last message
+};
+
+#endif  // PLANNER_METRICS_H
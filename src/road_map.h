@@ -0,0 +1,161 @@
+#ifndef ROAD_MAP_H
+#define ROAD_MAP_H
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "map_array.h"
+#include "waypoint_index.h"
+
+// One straight piece of the track, from waypoint i to waypoint i+1.
+struct RoadSegment {
+  double x, y;    // start waypoint
+  double s;       // cumulative s at the start waypoint
+  double length;  // distance to the next waypoint
+  double tx, ty;  // unit tangent, i.e. cos/sin of the segment heading
+  double nx, ny;  // unit normal, pointing towards positive d
+};
+
+// Waypoint map with everything getFrenet()/getXY() need precomputed once at
+// load time, so that a conversion is a segment lookup plus a projection:
+// no trig, no sqrt and no summing of segment lengths.
+//
+// The track is treated as a closed loop: the last segment runs from the
+// last waypoint back to the first, and s wraps around at max_s.
+class RoadMap {
+ public:
+  RoadMap() {}
+  RoadMap(const std::vector<double> &maps_x, const std::vector<double> &maps_y,
+          const std::vector<double> &maps_s, const std::vector<double> &maps_dx,
+          const std::vector<double> &maps_dy, double max_s) {
+    build(maps_x, maps_y, maps_s, maps_dx, maps_dy, max_s);
+  }
+
+  void build(const std::vector<double> &maps_x,
+             const std::vector<double> &maps_y,
+             const std::vector<double> &maps_s,
+             const std::vector<double> &maps_dx,
+             const std::vector<double> &maps_dy, double max_s) {
+    int n = maps_x.size();
+    max_s_ = max_s;
+    std::vector<RoadSegment> segments(n);
+    std::vector<double> seg_s(n);
+    for (int i = 0; i < n; i++) {
+      int j = (i + 1) % n;
+      RoadSegment &seg = segments[i];
+      seg.x = maps_x[i];
+      seg.y = maps_y[i];
+      seg.s = maps_s[i];
+      double ux = maps_x[j] - maps_x[i];
+      double uy = maps_y[j] - maps_y[i];
+      seg.length = sqrt(ux * ux + uy * uy);
+      seg.tx = (seg.length > 0) ? ux / seg.length : 1.0;
+      seg.ty = (seg.length > 0) ? uy / seg.length : 0.0;
+      // The map's dx/dy columns give the side of the road d is measured
+      // towards; use the exact perpendicular of the segment on that side so
+      // that getXY() and getFrenet() invert each other.
+      seg.nx = seg.ty;
+      seg.ny = -seg.tx;
+      double side = (maps_dx[i] + maps_dx[j]) * seg.nx +
+                    (maps_dy[i] + maps_dy[j]) * seg.ny;
+      if (side < 0) {
+        seg.nx = -seg.nx;
+        seg.ny = -seg.ny;
+      }
+      seg_s[i] = seg.s;
+    }
+    segments_.assign(segments);
+    seg_s_.assign(seg_s);
+    index_.build(maps_x, maps_y, true);
+
+    // Uniform buckets over [0, max_s), about half a segment long, each
+    // holding the segment that contains the bucket's start.
+    double mean_len = (n > 0) ? max_s / n : max_s;
+    int num_buckets = std::max(1, int(ceil(max_s / (0.5 * mean_len))));
+    bucket_inv_width_ = num_buckets / max_s;
+    std::vector<int> bucket(num_buckets + 1);
+    for (int b = 0; b <= num_buckets; b++) {
+      bucket[b] = segmentAtSBinarySearch(std::min(b / bucket_inv_width_, max_s));
+    }
+    bucket_.assign(bucket);
+  }
+
+  int size() const { return segments_.size(); }
+  double maxS() const { return max_s_; }
+  const RoadSegment &segment(int i) const { return segments_[i]; }
+  const WaypointIndex &index() const { return index_; }
+
+  // s wrapped into [0, max_s).
+  double wrapS(double s) const {
+    if (s >= 0 && s < max_s_) return s;
+    s = fmod(s, max_s_);
+    return (s < 0) ? s + max_s_ : s;
+  }
+
+  // Index of the segment containing the (already wrapped) s. The s bucket
+  // narrows it down to the segments overlapping the bucket; a short run is
+  // scanned, a long one (very uneven waypoint spacing) binary searched.
+  int segmentAtS(double s) const {
+    int b = std::min(int(s * bucket_inv_width_), int(bucket_.size()) - 2);
+    int lo = bucket_[b], hi = bucket_[b + 1];
+    if (hi - lo > kMaxBucketScan) {
+      return segmentAtSBinarySearch(s, lo, hi + 1);
+    }
+    while (lo < hi && seg_s_[lo + 1] <= s) lo++;
+    return lo;
+  }
+
+  // Same as segmentAtS(), by binary search over segments [first, last).
+  int segmentAtSBinarySearch(double s, int first = 0, int last = -1) const {
+    if (last < 0) last = seg_s_.size();
+    int i = int(std::upper_bound(seg_s_.begin() + first, seg_s_.begin() + last,
+                                 s) - seg_s_.begin()) - 1;
+    return std::max(i, 0);
+  }
+
+  // Transform from Cartesian x,y coordinates to Frenet s,d coordinates,
+  // projecting onto the closest segment.
+  std::array<double, 2> getFrenet(double x, double y) const {
+    return frenetOnSegment(index_.closestSegment(x, y), x, y);
+  }
+
+  // Projection of x,y onto the line through segment i.
+  std::array<double, 2> frenetOnSegment(int i, double x, double y) const {
+    const RoadSegment &seg = segments_[i];
+    double px = x - seg.x;
+    double py = y - seg.y;
+    double s = seg.s + px * seg.tx + py * seg.ty;
+    double d = px * seg.nx + py * seg.ny;
+    std::array<double, 2> sd = {{wrapS(s), d}};
+    return sd;
+  }
+
+  // Transform from Frenet s,d coordinates to Cartesian x,y.
+  std::array<double, 2> getXY(double s, double d) const {
+    s = wrapS(s);
+    return xyOnSegment(segmentAtS(s), s, d);
+  }
+
+  std::array<double, 2> xyOnSegment(int i, double s, double d) const {
+    const RoadSegment &seg = segments_[i];
+    double seg_s = s - seg.s;
+    std::array<double, 2> xy = {{seg.x + seg_s * seg.tx + d * seg.nx,
+                                 seg.y + seg_s * seg.ty + d * seg.ny}};
+    return xy;
+  }
+
+ private:
+  static const int kMaxBucketScan = 4;
+
+  friend class MapFile;  // reads and attaches the tables
+
+  MapArray<RoadSegment> segments_;
+  MapArray<double> seg_s_;  // segments_[i].s, packed for searching
+  MapArray<int> bucket_;    // segment containing s = b / bucket_inv_width_
+  double bucket_inv_width_ = 0;
+  WaypointIndex index_;
+  double max_s_ = 0;
+};
+
+#endif  // ROAD_MAP_H
@@ -0,0 +1,107 @@
+#ifndef SOCKET_IO_H
+#define SOCKET_IO_H
+
+#include <stddef.h>
+#include <string.h>
+
+// One websocket message from the simulator, split into its Engine.IO /
+// Socket.IO framing and payload. Nothing is copied: all spans point into
+// the message buffer, which does not need to be NUL terminated, and must
+// outlive the frame.
+//
+//   2                         Engine.IO ping, answered with a pong "3"
+//   3                         Engine.IO pong
+//   42["telemetry",{...}]     Socket.IO event "telemetry" with JSON data
+//   42["telemetry",null]      the same in manual mode: no data
+//
+// An event may also carry a namespace ("42/nsp,[...]") and an ack id
+// ("4217[...]"); both are skipped.
+struct SocketIoFrame {
+  enum Kind {
+    kInvalid,  // not an Engine.IO packet
+    kPing,
+    kPong,
+    kEvent,    // Socket.IO event; payload, name and data are set
+    kOther     // any other Engine.IO or Socket.IO packet
+  };
+
+  Kind kind;
+  const char *payload;  // the event's JSON array, e.g. ["telemetry",{...}]
+  size_t payload_length;
+  const char *name;     // event name, without the quotes
+  size_t name_length;
+  const char *data;     // second array element, e.g. {...}; 0 if missing
+  size_t data_length;
+
+  // True for an event with data other than null, i.e. not manual mode.
+  bool hasData() const {
+    return data && !(data_length == 4 && memcmp(data, "null", 4) == 0);
+  }
+
+  bool isEvent(const char *event_name) const {
+    size_t n = strlen(event_name);
+    return kind == kEvent && name_length == n && memcmp(name, event_name, n) == 0;
+  }
+};
+
+// Splits the message data[0, length) into a SocketIoFrame.
+inline SocketIoFrame parseSocketIoFrame(const char *data, size_t length) {
+  SocketIoFrame f = {SocketIoFrame::kInvalid, 0, 0, 0, 0, 0, 0};
+  if (length == 0) return f;
+  switch (data[0]) {
+    case '2':
+      f.kind = SocketIoFrame::kPing;
+      return f;
+    case '3':
+      f.kind = SocketIoFrame::kPong;
+      return f;
+    case '4':
+      break;
+    default:
+      f.kind = (data[0] >= '0' && data[0] <= '6') ? SocketIoFrame::kOther
+                                                  : SocketIoFrame::kInvalid;
+      return f;
+  }
+  f.kind = SocketIoFrame::kOther;
+  if (length < 2 || data[1] != '2') return f;
+
+  const char *p = data + 2;
+  const char *end = data + length;
+  if (p < end && *p == '/') {
+    while (p < end && *p != ',') p++;
+    if (p < end) p++;
+  }
+  while (p < end && *p >= '0' && *p <= '9') p++;
+  while (end > p && (end[-1] == ' ' || end[-1] == '\n' || end[-1] == '\r')) end--;
+  if (p == end || *p != '[' || end[-1] != ']') {
+    f.kind = SocketIoFrame::kInvalid;
+    return f;
+  }
+  f.kind = SocketIoFrame::kEvent;
+  f.payload = p;
+  f.payload_length = end - p;
+
+  // ["name", data]: the name is a plain string, data runs to the closing
+  // bracket of the array.
+  const char *q = p + 1;
+  const char *last = end - 1;
+  while (q < last && *q == ' ') q++;
+  if (q == last || *q != '"') return f;
+  f.name = ++q;
+  while (q < last && *q != '"') q += (*q == '\\') ? 2 : 1;
+  if (q >= last) {
+    f.name = 0;
+    return f;
+  }
+  f.name_length = q - f.name;
+  q++;
+  while (q < last && (*q == ' ' || *q == ',')) q++;
+  while (last > q && last[-1] == ' ') last--;
+  if (q < last) {
+    f.data = q;
+    f.data_length = last - q;
+  }
+  return f;
+}
+
+#endif  // SOCKET_IO_H
@@ -0,0 +1,202 @@
+#ifndef SPAN_TRACER_H
+#define SPAN_TRACER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records timed spans -- a name with begin and end times -- into a ring
+// buffer per thread, to look at individual slow frames after the fact.
+// chromeTrace() turns the last few seconds of every thread's spans into
+// Chrome trace_event JSON, for chrome://tracing or ui.perfetto.dev.
+//
+// A thread records nothing until registerThread() has set up its buffer;
+// after that, record() only writes into the preallocated ring, without
+// allocating or locking. Once a ring is full the oldest spans are
+// overwritten. Names must outlive the tracer (string literals do).
+class SpanTracer {
+ public:
+  struct Span {
+    const char *name;
+    uint64_t begin, end;  // steady clock, ns
+  };
+
+  static SpanTracer &instance() {
+    static SpanTracer tracer;
+    return tracer;
+  }
+
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Gives the calling thread a ring of `capacity` spans (rounded up to a
+  // power of two). Does nothing if it already has one.
+  void registerThread(const char *thread_name, int capacity = 1 << 16) {
+    if (local()) return;
+    int n = 1;
+    while (n < capacity) n *= 2;
+    std::unique_ptr<Buffer> buffer(new Buffer(thread_name, n));
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer->tid = buffers_.size() + 1;
+    local() = buffer.get();
+    buffers_.push_back(std::move(buffer));
+  }
+
+  void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Records a span that ends now: `end` is the current now(), which keeps
+  // each thread's ring in order of end time.
+  void record(const char *name, uint64_t begin, uint64_t end) {
+    Buffer *b = local();
+    if (!b || !enabled()) return;
+    uint64_t head = b->head.load(std::memory_order_relaxed);
+    Span &s = b->spans[head & b->mask];
+    s.name = name;
+    s.begin = begin;
+    s.end = end;
+    b->head.store(head + 1, std::memory_order_release);
+  }
+
+  // Most spans chromeTrace() renders by default: about 20 s of planner
+  // frames, which take about 2 ms to render.
+  static const size_t kMaxTraceSpans = 8192;
+
+  // Longest window chromeTrace() looks back over; a default ring holds
+  // about a minute of planner frames.
+  static const int kMaxTraceSeconds = 60;
+
+  // Every thread's spans that ended in the last `seconds` (clamped to
+  // [0, kMaxTraceSeconds], NaN counting as the maximum), as Chrome trace
+  // JSON; only the newest `max_spans` of them if there are more, and then
+  // otherData.truncated is "true". May run on any thread; spans being
+  // overwritten while it copies a ring are left out.
+  std::string chromeTrace(double seconds, size_t max_spans = kMaxTraceSpans) const {
+    if (!(seconds <= kMaxTraceSeconds)) seconds = kMaxTraceSeconds;
+    if (!(seconds > 0)) seconds = 0;
+    uint64_t window = uint64_t(seconds * 1e9);
+    uint64_t t = now();
+    uint64_t since = t > window ? t - window : 0;
+    std::vector<ThreadSpan> spans;
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char line[256];
+    bool truncated = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::vector<Span> ring;
+      for (const std::unique_ptr<Buffer> &b : buffers_) {
+        snprintf(line, sizeof(line),
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                 "\"args\":{\"name\":\"%s\"}}",
+                 b == buffers_.front() ? "" : ",", b->tid, b->name);
+        out += line;
+        truncated |= b->copy(since, max_spans, &ring);
+        for (const Span &s : ring) {
+          ThreadSpan ts = {s, b->tid};
+          spans.push_back(ts);
+        }
+      }
+    }
+    if (spans.size() > max_spans) {
+      size_t dropped = spans.size() - max_spans;
+      std::nth_element(spans.begin(), spans.begin() + dropped, spans.end(), endsBefore);
+      spans.erase(spans.begin(), spans.begin() + dropped);
+      truncated = true;
+    }
+    for (const ThreadSpan &ts : spans) {
+      const Span &s = ts.span;
+      // Microseconds with three decimals, formatted as integers, which is
+      // several times faster than printing doubles
+      uint64_t dur = s.end - s.begin;
+      snprintf(line, sizeof(line),
+               ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+               "\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+               s.name, ts.tid, (unsigned long long)(s.begin / 1000), unsigned(s.begin % 1000),
+               (unsigned long long)(dur / 1000), unsigned(dur % 1000));
+      out += line;
+    }
+    out += truncated ? "],\"otherData\":{\"truncated\":\"true\"}}"
+                     : "],\"otherData\":{\"truncated\":\"false\"}}";
+    return out;
+  }
+
+ private:
+  struct Buffer {
+    Buffer(const char *thread_name, int n)
+        : name(thread_name), spans(n), mask(n - 1), head(0), tid(0) {}
+
+    // The newest spans still in the ring that ended at `since` or later,
+    // at most `max` of them, oldest first. Spans are recorded as they end,
+    // so the ring is in order of end time and the scan stops at the first
+    // older one. Returns whether spans were left out for `max`.
+    bool copy(uint64_t since, size_t max, std::vector<Span> *out) const {
+      uint64_t end = head.load(std::memory_order_acquire);
+      uint64_t oldest = (end > mask + 1) ? end - (mask + 1) : 0;
+      uint64_t first = end;
+      while (first > oldest && end - first < max && spans[(first - 1) & mask].end >= since) {
+        first--;
+      }
+      out->clear();
+      for (uint64_t i = first; i < end; i++) out->push_back(spans[i & mask]);
+      // Drop the ones the recording thread overwrote meanwhile.
+      uint64_t now_head = head.load(std::memory_order_acquire);
+      uint64_t lost = (now_head > mask + 1) ? now_head - (mask + 1) : 0;
+      uint64_t overwritten = (lost > first) ? lost - first : 0;
+      out->erase(out->begin(),
+                 out->begin() + std::min<uint64_t>(overwritten, out->size()));
+      return first > oldest && end - first == max && spans[(first - 1) & mask].end >= since;
+    }
+
+    const char *name;
+    std::vector<Span> spans;
+    uint64_t mask;
+    std::atomic<uint64_t> head;
+    int tid;
+  };
+
+  // A span and the thread that recorded it.
+  struct ThreadSpan {
+    Span span;
+    int tid;
+  };
+  static bool endsBefore(const ThreadSpan &a, const ThreadSpan &b) {
+    return a.span.end < b.span.end;
+  }
+
+  SpanTracer() : enabled_(true) {}
+
+  static Buffer *&local() {
+    static thread_local Buffer *buffer = 0;
+    return buffer;
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer> > buffers_;
+  std::atomic<bool> enabled_;
+};
+
+// Records a span from its construction to the end of the scope.
+class ScopedSpan {
+ public:
+  explicit ScopedSpan(const char *name) : name_(name), begin_(SpanTracer::now()) {}
+  ~ScopedSpan() { SpanTracer::instance().record(name_, begin_, SpanTracer::now()); }
+
+ private:
+  const char *name_;
+  uint64_t begin_;
+};
+
+#define TRACE_SPAN_CONCAT2(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT2(a, b)
+#define TRACE_SPAN(name) ScopedSpan TRACE_SPAN_CONCAT(trace_span_, __LINE__)(name)
+
+#endif  // SPAN_TRACER_H
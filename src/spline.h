@@ -29,6 +29,7 @@
 
 #include <cstdio>
 #include <cassert>
+#include <array>
 #include <vector>
 #include <algorithm>
 
@@ -41,30 +42,75 @@ namespace
 namespace tk
 {
 
+// heap array of doubles starting on a cache line, zero-initialized
+class aligned_buffer
+{
+private:
+    void*   m_raw;
+    double* m_data;
+    size_t  m_size;
+public:
+    aligned_buffer(): m_raw(0), m_data(0), m_size(0) {}
+    aligned_buffer(const aligned_buffer& o): m_raw(0), m_data(0), m_size(0)
+    {
+        *this=o;
+    }
+    aligned_buffer& operator= (const aligned_buffer& o);
+    ~aligned_buffer()
+    {
+        ::operator delete(m_raw);
+    }
+    void resize(size_t n);                       // discards the contents
+    size_t size() const
+    {
+        return m_size;
+    }
+    double* data()
+    {
+        return m_data;
+    }
+    const double* data() const
+    {
+        return m_data;
+    }
+};
+
 // band matrix solver
+// all diagonals are kept in one buffer, one after the other (diagonal-major):
+// the saved diagonal, the lower ones from the outermost in, the main
+// diagonal, then the upper ones; entry (i,j) is entry i of its diagonal
 class band_matrix
 {
 private:
-    std::vector< std::vector<double> > m_upper;  // upper band
-    std::vector< std::vector<double> > m_lower;  // lower band
+    aligned_buffer m_data;
+    int m_dim, m_num_upper, m_num_lower;
+    // no bounds checks, for the solver loops
+    double& at(int i, int j)
+    {
+        return m_data.data()[(m_num_lower+1+j-i)*m_dim+i];
+    }
+    double  at(int i, int j) const
+    {
+        return m_data.data()[(m_num_lower+1+j-i)*m_dim+i];
+    }
 public:
-    band_matrix() {};                             // constructor
+    band_matrix(): m_dim(0), m_num_upper(0), m_num_lower(0) {};   // constructor
     band_matrix(int dim, int n_u, int n_l);       // constructor
     ~band_matrix() {};                            // destructor
     void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
     int dim() const;                             // matrix dimension
     int num_upper() const
     {
-        return m_upper.size()-1;
+        return m_num_upper;
     }
     int num_lower() const
     {
-        return m_lower.size()-1;
+        return m_num_lower;
     }
     // access operator
     double & operator () (int i, int j);            // write
     double   operator () (int i, int j) const;      // read
-    // we can store an additional diogonal (in m_lower)
+    // we can store an additional diogonal (in front of the lower ones)
     double& saved_diag(int i);
     double  saved_diag(int i) const;
     void lu_decompose();
@@ -72,6 +118,11 @@ public:
     std::vector<double> l_solve(const std::vector<double>& b) const;
     std::vector<double> lu_solve(const std::vector<double>& b,
                                  bool is_lu_decomposed=false);
+    // in place: b holds dim() values and is overwritten by the solution,
+    // without allocating
+    void r_solve(double* b) const;
+    void l_solve(double* b) const;
+    void lu_solve(double* b, bool is_lu_decomposed=false);
 
 };
 
@@ -94,6 +145,14 @@ private:
     bd_type m_left, m_right;
     double  m_left_value, m_right_value;
     bool    m_force_linear_extrapolation;
+    // the same coefficients packed per interval for the batch evaluation:
+    // a, b, c, y, x of interval i in cache line i
+    static const int packed_stride=8;
+    aligned_buffer m_packed;
+
+    void eval_interval(int idx, const double* xs, double* ys, size_t n) const;
+    void eval_derivs_interval(int idx, const double* xs, double* f,
+                              double* df, double* ddf, size_t n) const;
 
 public:
     // set default boundary condition to be zero curvature at both ends
@@ -111,6 +170,64 @@ public:
     void set_points(const std::vector<double>& x,
                     const std::vector<double>& y, bool cubic_spline=true);
     double operator() (double x) const;
+    double deriv(int order, double x) const;
+    // ys[k]=operator()(xs[k]) for k<n, bit for bit. eval_batch is a scalar
+    // loop: it still searches each point's interval, and only saves reading
+    // the coefficients from four vectors. The sorted version needs xs in
+    // ascending order and walks the intervals with a cursor instead of
+    // searching them, evaluating each run of points that falls into one
+    // interval with the coefficients in registers (a loop gcc vectorizes
+    // at -O3, not at -O2)
+    void eval_batch(const double* xs, double* ys, size_t n) const;
+    void eval_batch_sorted(const double* xs, double* ys, size_t n) const;
+    // value, first and second derivative at x from one interval lookup,
+    // the same as operator(), deriv(1,x) and deriv(2,x)
+    void eval_derivs(double x, double& f, double& df, double& ddf) const;
+    // the same at n points in ascending order, walking the intervals with
+    // a cursor as eval_batch_sorted() does
+    void eval_derivs_batch_sorted(const double* xs, double* f, double* df,
+                                  double* ddf, size_t n) const;
+};
+
+
+// spline through exactly N points with its storage held inline, so that
+// set_points() does not touch the heap; for small fits redone every frame
+template<int N>
+class fixed_spline
+{
+public:
+    typedef spline::bd_type bd_type;
+
+private:
+    std::array<double,N> m_x,m_y;           // x,y coordinates of points
+    // interpolation parameters, as in spline
+    std::array<double,N> m_a,m_b,m_c;       // spline coefficients
+    double  m_b0, m_c0;                     // for left extrapol
+    bd_type m_left, m_right;
+    double  m_left_value, m_right_value;
+    bool    m_force_linear_extrapolation;
+
+public:
+    // set default boundary condition to be zero curvature at both ends
+    fixed_spline(): m_left(spline::second_deriv), m_right(spline::second_deriv),
+        m_left_value(0.0), m_right_value(0.0),
+        m_force_linear_extrapolation(false)
+    {
+        ;
+    }
+
+    // optional, but if called it has to come be before set_points()
+    void set_boundary(bd_type left, double left_value,
+                      bd_type right, double right_value,
+                      bool force_linear_extrapolation=false);
+    void set_points(const double* x, const double* y, bool cubic_spline=true);
+    void set_points(const std::vector<double>& x,
+                    const std::vector<double>& y, bool cubic_spline=true)
+    {
+        assert(x.size()==N && y.size()==N);
+        set_points(x.data(), y.data(), cubic_spline);
+    }
+    double operator() (double x) const;
 };
 
 
@@ -120,6 +237,31 @@ public:
 // ---------------------------------------------------------------------
 
 
+// aligned_buffer implementation
+// -----------------------------
+
+aligned_buffer& aligned_buffer::operator= (const aligned_buffer& o)
+{
+    if(this!=&o) {
+        resize(o.m_size);
+        std::copy(o.m_data, o.m_data+o.m_size, m_data);
+    }
+    return *this;
+}
+void aligned_buffer::resize(size_t n)
+{
+    const size_t line=64;
+    if(n!=m_size) {
+        ::operator delete(m_raw);
+        m_raw=::operator new(n*sizeof(double)+line);
+        size_t misalign=reinterpret_cast<size_t>(m_raw) % line;
+        m_data=reinterpret_cast<double*>(static_cast<char*>(m_raw)+(line-misalign) % line);
+        m_size=n;
+    }
+    std::fill(m_data, m_data+n, 0.0);
+}
+
+
 // band_matrix implementation
 // -------------------------
 
@@ -132,22 +274,14 @@ void band_matrix::resize(int dim, int n_u, int n_l)
     assert(dim>0);
     assert(n_u>=0);
     assert(n_l>=0);
-    m_upper.resize(n_u+1);
-    m_lower.resize(n_l+1);
-    for(size_t i=0; i<m_upper.size(); i++) {
-        m_upper[i].resize(dim);
-    }
-    for(size_t i=0; i<m_lower.size(); i++) {
-        m_lower[i].resize(dim);
-    }
+    m_dim=dim;
+    m_num_upper=n_u;
+    m_num_lower=n_l;
+    m_data.resize(size_t(n_u+n_l+2)*dim);
 }
 int band_matrix::dim() const
 {
-    if(m_upper.size()>0) {
-        return m_upper[0].size();
-    } else {
-        return 0;
-    }
+    return m_dim;
 }
 
 
@@ -159,8 +293,7 @@ double & band_matrix::operator () (int i, int j)
     assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
     assert( (-num_lower()<=k) && (k<=num_upper()) );
     // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    return at(i,j);
 }
 double band_matrix::operator () (int i, int j) const
 {
@@ -168,84 +301,149 @@ double band_matrix::operator () (int i, int j) const
     assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
     assert( (-num_lower()<=k) && (k<=num_upper()) );
     // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    return at(i,j);
 }
-// second diag (used in LU decomposition), saved in m_lower
+// second diag (used in LU decomposition), saved in front of the lower bands
 double band_matrix::saved_diag(int i) const
 {
     assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    return m_data.data()[i];
 }
 double & band_matrix::saved_diag(int i)
 {
     assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    return m_data.data()[i];
 }
 
-// LR-Decomposition of a band matrix
+// LR-Decomposition of a band matrix, in place
 void band_matrix::lu_decompose()
 {
+    const int n=m_dim;
+    double* saved=m_data.data();
     int  i_max,j_max;
     int  j_min;
     double x;
 
+    if(m_num_upper==1 && m_num_lower==1) {
+        // tridiagonal, as for splines: the same operations as below, on
+        // the three diagonals directly, in one pass
+        double* lower=saved+n;
+        double* diag=lower+n;
+        double* upper=diag+n;
+        for(int i=0; i<n; i++) {
+            assert(diag[i]!=0.0);
+            saved[i]=1.0/diag[i];
+            if(i>0)   lower[i] *= saved[i];
+            if(i<n-1) upper[i] *= saved[i];
+            diag[i]=1.0;
+            if(i>0) {
+                x=-lower[i]/diag[i-1];
+                lower[i]=-x;
+                diag[i]=diag[i]+x*upper[i-1];
+            }
+        }
+        return;
+    }
+
     // preconditioning
     // normalize column i so that a_ii=1
-    for(int i=0; i<this->dim(); i++) {
-        assert(this->operator()(i,i)!=0.0);
-        this->saved_diag(i)=1.0/this->operator()(i,i);
-        j_min=std::max(0,i-this->num_lower());
-        j_max=std::min(this->dim()-1,i+this->num_upper());
+    for(int i=0; i<n; i++) {
+        assert(at(i,i)!=0.0);
+        saved[i]=1.0/at(i,i);
+        j_min=std::max(0,i-m_num_lower);
+        j_max=std::min(n-1,i+m_num_upper);
         for(int j=j_min; j<=j_max; j++) {
-            this->operator()(i,j) *= this->saved_diag(i);
+            at(i,j) *= saved[i];
         }
-        this->operator()(i,i)=1.0;          // prevents rounding errors
+        at(i,i)=1.0;          // prevents rounding errors
     }
 
     // Gauss LR-Decomposition
-    for(int k=0; k<this->dim(); k++) {
-        i_max=std::min(this->dim()-1,k+this->num_lower());  // num_lower not a mistake!
+    for(int k=0; k<n; k++) {
+        i_max=std::min(n-1,k+m_num_lower);  // num_lower not a mistake!
         for(int i=k+1; i<=i_max; i++) {
-            assert(this->operator()(k,k)!=0.0);
-            x=-this->operator()(i,k)/this->operator()(k,k);
-            this->operator()(i,k)=-x;                         // assembly part of L
-            j_max=std::min(this->dim()-1,k+this->num_upper());
+            assert(at(k,k)!=0.0);
+            x=-at(i,k)/at(k,k);
+            at(i,k)=-x;                         // assembly part of L
+            j_max=std::min(n-1,k+m_num_upper);
             for(int j=k+1; j<=j_max; j++) {
                 // assembly part of R
-                this->operator()(i,j)=this->operator()(i,j)+x*this->operator()(k,j);
+                at(i,j)=at(i,j)+x*at(k,j);
             }
         }
     }
 }
-// solves Ly=b
-std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
+// solves Ly=b in place
+void band_matrix::l_solve(double* b) const
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
+    const int n=m_dim;
+    const double* saved=m_data.data();
     int j_start;
     double sum;
-    for(int i=0; i<this->dim(); i++) {
+    if(m_num_lower==1) {
+        const double* lower=saved+n;
+        b[0]=(b[0]*saved[0]) - 0.0;
+        for(int i=1; i<n; i++) {
+            sum=0;
+            sum += lower[i]*b[i-1];
+            b[i]=(b[i]*saved[i]) - sum;
+        }
+        return;
+    }
+    for(int i=0; i<n; i++) {
         sum=0;
-        j_start=std::max(0,i-this->num_lower());
-        for(int j=j_start; j<i; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=(b[i]*this->saved_diag(i)) - sum;
+        j_start=std::max(0,i-m_num_lower);
+        for(int j=j_start; j<i; j++) sum += at(i,j)*b[j];
+        b[i]=(b[i]*saved[i]) - sum;
     }
-    return x;
 }
-// solves Rx=y
-std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
+// solves Rx=y in place
+void band_matrix::r_solve(double* b) const
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
+    const int n=m_dim;
     int j_stop;
     double sum;
-    for(int i=this->dim()-1; i>=0; i--) {
+    if(m_num_upper==1) {
+        const double* diag=m_data.data()+(m_num_lower+1)*n;
+        const double* upper=diag+n;
+        b[n-1]=( b[n-1] - 0.0 ) / diag[n-1];
+        for(int i=n-2; i>=0; i--) {
+            sum=0;
+            sum += upper[i]*b[i+1];
+            b[i]=( b[i] - sum ) / diag[i];
+        }
+        return;
+    }
+    for(int i=n-1; i>=0; i--) {
         sum=0;
-        j_stop=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=i+1; j<=j_stop; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=( b[i] - sum ) / this->operator()(i,i);
+        j_stop=std::min(n-1,i+m_num_upper);
+        for(int j=i+1; j<=j_stop; j++) sum += at(i,j)*b[j];
+        b[i]=( b[i] - sum ) / at(i,i);
     }
+}
+void band_matrix::lu_solve(double* b, bool is_lu_decomposed)
+{
+    if(is_lu_decomposed==false) {
+        this->lu_decompose();
+    }
+    l_solve(b);
+    r_solve(b);
+}
+
+// solves Ly=b
+std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
+{
+    assert( this->dim()==(int)b.size() );
+    std::vector<double> x(b);
+    l_solve(x.data());
+    return x;
+}
+// solves Rx=y
+std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
+{
+    assert( this->dim()==(int)b.size() );
+    std::vector<double> x(b);
+    r_solve(x.data());
     return x;
 }
 
@@ -253,12 +451,8 @@ std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
         bool is_lu_decomposed)
 {
     assert( this->dim()==(int)b.size() );
-    std::vector<double>  x,y;
-    if(is_lu_decomposed==false) {
-        this->lu_decompose();
-    }
-    y=this->l_solve(b);
-    x=this->r_solve(y);
+    std::vector<double> x(b);
+    lu_solve(x.data(), is_lu_decomposed);
     return x;
 }
 
@@ -337,7 +531,8 @@ void spline::set_points(const std::vector<double>& x,
         }
 
         // solve the equation system to obtain the parameters b[]
-        m_b=A.lu_solve(rhs);
+        A.lu_solve(rhs.data());
+        m_b.swap(rhs);
 
         // calculate parameters a[] and c[] based on b[]
         m_a.resize(n);
@@ -370,6 +565,16 @@ void spline::set_points(const std::vector<double>& x,
     m_c[n-1]=3.0*m_a[n-2]*h*h+2.0*m_b[n-2]*h+m_c[n-2];   // = f'_{n-2}(x_{n-1})
     if(m_force_linear_extrapolation==true)
         m_b[n-1]=0.0;
+
+    m_packed.resize(size_t(n)*packed_stride);
+    for(int i=0; i<n; i++) {
+        double* p=m_packed.data()+i*packed_stride;
+        p[0]=m_a[i];
+        p[1]=m_b[i];
+        p[2]=m_c[i];
+        p[3]=m_y[i];
+        p[4]=m_x[i];
+    }
 }
 
 double spline::operator() (double x) const
@@ -395,6 +600,318 @@ double spline::operator() (double x) const
     return interpol;
 }
 
+// derivative of order 1, 2 or 3 at x
+double spline::deriv(int order, double x) const
+{
+    assert(order>0);
+    size_t n=m_x.size();
+    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+    std::vector<double>::const_iterator it;
+    it=std::lower_bound(m_x.begin(),m_x.end(),x);
+    int idx=std::max( int(it-m_x.begin())-1, 0);
+
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b0*h + m_c0;
+            break;
+        case 2:
+            interpol=2.0*m_b0;
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else if(x>m_x[n-1]) {
+        // extrapolation to the right
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b[n-1]*h + m_c[n-1];
+            break;
+        case 2:
+            interpol=2.0*m_b[n-1];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else {
+        // interpolation
+        switch(order) {
+        case 1:
+            interpol=(3.0*m_a[idx]*h + 2.0*m_b[idx])*h + m_c[idx];
+            break;
+        case 2:
+            interpol=6.0*m_a[idx]*h + 2.0*m_b[idx];
+            break;
+        case 3:
+            interpol=6.0*m_a[idx];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    }
+    return interpol;
+}
+
+
+// interpolation at n points that all lie in interval idx
+void spline::eval_interval(int idx, const double* xs, double* ys, size_t n) const
+{
+    const double* p=m_packed.data()+idx*packed_stride;
+    const double a=p[0], b=p[1], c=p[2], y=p[3], x0=p[4];
+    for(size_t k=0; k<n; k++) {
+        double h=xs[k]-x0;
+        ys[k]=((a*h + b)*h + c)*h + y;
+    }
+}
+
+// value, first and second derivative at n points that all lie in interval idx
+void spline::eval_derivs_interval(int idx, const double* xs, double* f,
+                                  double* df, double* ddf, size_t n) const
+{
+    const double* p=m_packed.data()+idx*packed_stride;
+    const double a=p[0], b=p[1], c=p[2], y=p[3], x0=p[4];
+    for(size_t k=0; k<n; k++) {
+        double h=xs[k]-x0;
+        f[k]=((a*h + b)*h + c)*h + y;
+        df[k]=(3.0*a*h + 2.0*b)*h + c;
+        ddf[k]=6.0*a*h + 2.0*b;
+    }
+}
+
+void spline::eval_batch(const double* xs, double* ys, size_t n) const
+{
+    const int nx=m_x.size();
+    for(size_t k=0; k<n; k++) {
+        double x=xs[k];
+        if(x<m_x[0] || x>m_x[nx-1]) {
+            ys[k]=(*this)(x);   // extrapolation
+            continue;
+        }
+        // the interval operator() picks: x[idx] < x <= x[idx+1]
+        int idx=std::max( int(std::lower_bound(m_x.begin(),m_x.end(),x)-m_x.begin())-1, 0);
+        eval_interval(idx, xs+k, ys+k, 1);
+    }
+}
+
+void spline::eval_batch_sorted(const double* xs, double* ys, size_t n) const
+{
+    const int nx=m_x.size();
+    size_t k=0;
+    // extrapolation to the left
+    for(; k<n && xs[k]<m_x[0]; k++) ys[k]=(*this)(xs[k]);
+    int idx=0;
+    while(k<n && xs[k]<=m_x[nx-1]) {
+        while(xs[k]>m_x[idx+1]) idx++;
+        size_t end=k+1;
+        while(end<n && xs[end]<=m_x[idx+1]) end++;
+        eval_interval(idx, xs+k, ys+k, end-k);
+        k=end;
+    }
+    // extrapolation to the right
+    for(; k<n; k++) ys[k]=(*this)(xs[k]);
+}
+
+
+void spline::eval_derivs(double x, double& f, double& df, double& ddf) const
+{
+    size_t n=m_x.size();
+    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+    std::vector<double>::const_iterator it;
+    it=std::lower_bound(m_x.begin(),m_x.end(),x);
+    int idx=std::max( int(it-m_x.begin())-1, 0);
+
+    double h=x-m_x[idx];
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        f=(m_b0*h + m_c0)*h + m_y[0];
+        df=2.0*m_b0*h + m_c0;
+        ddf=2.0*m_b0;
+    } else if(x>m_x[n-1]) {
+        // extrapolation to the right
+        f=(m_b[n-1]*h + m_c[n-1])*h + m_y[n-1];
+        df=2.0*m_b[n-1]*h + m_c[n-1];
+        ddf=2.0*m_b[n-1];
+    } else {
+        // interpolation
+        f=((m_a[idx]*h + m_b[idx])*h + m_c[idx])*h + m_y[idx];
+        df=(3.0*m_a[idx]*h + 2.0*m_b[idx])*h + m_c[idx];
+        ddf=6.0*m_a[idx]*h + 2.0*m_b[idx];
+    }
+}
+
+
+void spline::eval_derivs_batch_sorted(const double* xs, double* f, double* df,
+                                      double* ddf, size_t n) const
+{
+    const int nx=m_x.size();
+    size_t k=0;
+    // extrapolation to the left
+    for(; k<n && xs[k]<m_x[0]; k++) eval_derivs(xs[k], f[k], df[k], ddf[k]);
+    int idx=0;
+    while(k<n && xs[k]<=m_x[nx-1]) {
+        while(xs[k]>m_x[idx+1]) idx++;
+        size_t end=k+1;
+        while(end<n && xs[end]<=m_x[idx+1]) end++;
+        eval_derivs_interval(idx, xs+k, f+k, df+k, ddf+k, end-k);
+        k=end;
+    }
+    // extrapolation to the right
+    for(; k<n; k++) eval_derivs(xs[k], f[k], df[k], ddf[k]);
+}
+
+// fixed_spline implementation
+// ---------------------------
+
+template<int N>
+void fixed_spline<N>::set_boundary(bd_type left, double left_value,
+                                   bd_type right, double right_value,
+                                   bool force_linear_extrapolation)
+{
+    m_left=left;
+    m_right=right;
+    m_left_value=left_value;
+    m_right_value=right_value;
+    m_force_linear_extrapolation=force_linear_extrapolation;
+}
+
+// Same equations as spline::set_points(). The tridiagonal system is solved
+// with the Thomas algorithm on three diagonals, doing the floating point
+// operations of band_matrix::lu_solve() in the same order (including its
+// row scaling and zero-initialized sums), so that the coefficients and
+// values are bit for bit those of spline. The loop bounds are constants,
+// which lets the compiler unroll them.
+template<int N>
+void fixed_spline<N>::set_points(const double* x, const double* y,
+                                 bool cubic_spline)
+{
+    static_assert(N>2, "a spline needs at least 3 points");
+    const int n=N;
+    for(int i=0; i<n; i++) {
+        m_x[i]=x[i];
+        m_y[i]=y[i];
+    }
+    for(int i=0; i<n-1; i++) {
+        assert(m_x[i]<m_x[i+1]);
+    }
+
+    if(cubic_spline==true) { // cubic spline interpolation
+        // the matrix A(i,i-1), A(i,i), A(i,i+1) and right hand side for b[]
+        std::array<double,N> lower, diag, upper, rhs, saved;
+        lower[0]=upper[n-1]=0.0;
+        for(int i=1; i<n-1; i++) {
+            lower[i]=1.0/3.0*(x[i]-x[i-1]);
+            diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+            upper[i]=1.0/3.0*(x[i+1]-x[i]);
+            rhs[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+        }
+        // boundary conditions
+        if(m_left == spline::second_deriv) {
+            diag[0]=2.0;
+            upper[0]=0.0;
+            rhs[0]=m_left_value;
+        } else if(m_left == spline::first_deriv) {
+            diag[0]=2.0*(x[1]-x[0]);
+            upper[0]=1.0*(x[1]-x[0]);
+            rhs[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+        } else {
+            assert(false);
+        }
+        if(m_right == spline::second_deriv) {
+            diag[n-1]=2.0;
+            lower[n-1]=0.0;
+            rhs[n-1]=m_right_value;
+        } else if(m_right == spline::first_deriv) {
+            diag[n-1]=2.0*(x[n-1]-x[n-2]);
+            lower[n-1]=1.0*(x[n-1]-x[n-2]);
+            rhs[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+        } else {
+            assert(false);
+        }
+
+        // preconditioning: normalize row i so that a_ii=1
+        for(int i=0; i<n; i++) {
+            assert(diag[i]!=0.0);
+            saved[i]=1.0/diag[i];
+            lower[i]*=saved[i];
+            upper[i]*=saved[i];
+            diag[i]=1.0;
+        }
+        // forward elimination
+        for(int k=0; k<n-1; k++) {
+            double f=-lower[k+1]/diag[k];
+            lower[k+1]=-f;
+            diag[k+1]=diag[k+1]+f*upper[k];
+        }
+        // solve Ly=rhs, then Rb=y
+        std::array<double,N> z;
+        for(int i=0; i<n; i++) {
+            double sum=0;
+            if(i>0) sum += lower[i]*z[i-1];
+            z[i]=(rhs[i]*saved[i]) - sum;
+        }
+        for(int i=n-1; i>=0; i--) {
+            double sum=0;
+            if(i<n-1) sum += upper[i]*m_b[i+1];
+            m_b[i]=( z[i] - sum ) / diag[i];
+        }
+
+        // calculate parameters a[] and c[] based on b[]
+        for(int i=0; i<n-1; i++) {
+            m_a[i]=1.0/3.0*(m_b[i+1]-m_b[i])/(x[i+1]-x[i]);
+            m_c[i]=(y[i+1]-y[i])/(x[i+1]-x[i])
+                   - 1.0/3.0*(2.0*m_b[i]+m_b[i+1])*(x[i+1]-x[i]);
+        }
+    } else { // linear interpolation
+        for(int i=0; i<n-1; i++) {
+            m_a[i]=0.0;
+            m_b[i]=0.0;
+            m_c[i]=(m_y[i+1]-m_y[i])/(m_x[i+1]-m_x[i]);
+        }
+        m_b[n-1]=0.0;
+    }
+
+    // for left extrapolation coefficients
+    m_b0 = (m_force_linear_extrapolation==false) ? m_b[0] : 0.0;
+    m_c0 = m_c[0];
+
+    // for the right extrapolation coefficients
+    double h=x[n-1]-x[n-2];
+    m_a[n-1]=0.0;
+    m_c[n-1]=3.0*m_a[n-2]*h*h+2.0*m_b[n-2]*h+m_c[n-2];   // = f'_{n-2}(x_{n-1})
+    if(m_force_linear_extrapolation==true)
+        m_b[n-1]=0.0;
+}
+
+template<int N>
+double fixed_spline<N>::operator() (double x) const
+{
+    const int n=N;
+    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+    typename std::array<double,N>::const_iterator it;
+    it=std::lower_bound(m_x.begin(),m_x.end(),x);
+    int idx=std::max( int(it-m_x.begin())-1, 0);
+
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        interpol=(m_b0*h + m_c0)*h + m_y[0];
+    } else if(x>m_x[n-1]) {
+        // extrapolation to the right
+        interpol=(m_b[n-1]*h + m_c[n-1])*h + m_y[n-1];
+    } else {
+        // interpolation
+        interpol=((m_a[idx]*h + m_b[idx])*h + m_c[idx])*h + m_y[idx];
+    }
+    return interpol;
+}
+
 
 } // namespace tk
 
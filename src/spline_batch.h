@@ -0,0 +1,247 @@
+#ifndef SPLINE_BATCH_H
+#define SPLINE_BATCH_H
+
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "spline.h"
+
+// K cubic splines through N points each, fitted and evaluated together,
+// e.g. the paths of K candidate lane and speed choices. The splines are
+// kept in packs of four, struct of arrays: knot i of the four splines of a
+// pack is one Eigen array of four, so each step of the tridiagonal solve
+// is one fixed size array expression, with one SIMD lane per spline and
+// four independent division chains instead of one. The last pack is padded
+// with copies of the last spline.
+//
+// eval() goes spline by spline: each needs its own interval, and gathering
+// the coefficients into packs costs more than the packed polynomial saves.
+//
+// Same equations and operations as tk::spline and tk::fixed_spline<N>
+// (cubic, either boundary type), so every spline of the batch gives the
+// same values, bit for bit, as fitting it alone. The packs are reused
+// between fits, so refitting no more splines than before does not
+// allocate.
+//
+// In the unnamed namespace like tk::spline.
+namespace
+{
+
+namespace tk
+{
+
+template<int N>
+class spline_batch
+{
+public:
+    typedef spline::bd_type bd_type;
+    static const int pack_size=4;
+    typedef Eigen::Array<double, pack_size, 1> pack;
+
+private:
+    struct packed_splines {
+        pack x[N], y[N];
+        pack a[N], b[N], c[N];      // spline coefficients
+        pack b0;                    // for left extrapol
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::vector<packed_splines, Eigen::aligned_allocator<packed_splines> > m_packs;
+    int     m_size;
+    bd_type m_left, m_right;
+    double  m_left_value, m_right_value;
+    bool    m_force_linear_extrapolation;
+
+    void fit(packed_splines& s) const;
+    static pack lanes(const double* v, int j, int k);
+
+public:
+    // set default boundary condition to be zero curvature at both ends
+    spline_batch(): m_size(0), m_left(spline::second_deriv),
+        m_right(spline::second_deriv), m_left_value(0.0), m_right_value(0.0),
+        m_force_linear_extrapolation(false)
+    {
+        static_assert(N>2, "a spline needs at least 3 points");
+    }
+
+    // optional, but if called it has to come be before set_points();
+    // the same for every spline of the batch
+    void set_boundary(bd_type left, double left_value,
+                      bd_type right, double right_value,
+                      bool force_linear_extrapolation=false)
+    {
+        m_left=left;
+        m_right=right;
+        m_left_value=left_value;
+        m_right_value=right_value;
+        m_force_linear_extrapolation=force_linear_extrapolation;
+    }
+
+    int size() const
+    {
+        return m_size;
+    }
+
+    // fits k splines; point i of spline j is (x[i*k+j], y[i*k+j])
+    void set_points(const double* x, const double* y, int k);
+    // ys[j]=spline j at xs[j], for all size() splines
+    void eval(const double* xs, double* ys) const;
+    // spline j at x
+    double operator() (int j, double x) const;
+};
+
+
+// v[j..j+3], with v[k-1] past the end
+template<int N>
+typename spline_batch<N>::pack spline_batch<N>::lanes(const double* v, int j, int k)
+{
+    if(j+pack_size<=k) return Eigen::Map<const pack>(v+j);
+    pack p;
+    for(int l=0; l<pack_size; l++) p[l]=v[std::min(j+l, k-1)];
+    return p;
+}
+
+template<int N>
+void spline_batch<N>::set_points(const double* x, const double* y, int k)
+{
+    assert(k>0);
+    m_size=k;
+    m_packs.resize((k+pack_size-1)/pack_size);
+    for(size_t p=0; p<m_packs.size(); p++) {
+        packed_splines& s=m_packs[p];
+        for(int i=0; i<N; i++) {
+            s.x[i]=lanes(x+i*k, p*pack_size, k);
+            s.y[i]=lanes(y+i*k, p*pack_size, k);
+        }
+        fit(s);
+    }
+}
+
+// fixed_spline::set_points(), on four splines at a time
+template<int N>
+void spline_batch<N>::fit(packed_splines& s) const
+{
+    const int n=N;
+    const pack* x=s.x;
+    const pack* y=s.y;
+    for(int i=0; i<n-1; i++) {
+        assert((x[i]<x[i+1]).all());
+    }
+
+    // the matrix A(i,i-1), A(i,i), A(i,i+1) and right hand side for b[]
+    pack lower[N], diag[N], upper[N], rhs[N], saved[N];
+    lower[0].setZero();
+    upper[n-1].setZero();
+    for(int i=1; i<n-1; i++) {
+        lower[i]=1.0/3.0*(x[i]-x[i-1]);
+        diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+        upper[i]=1.0/3.0*(x[i+1]-x[i]);
+        rhs[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+    }
+    // boundary conditions
+    if(m_left == spline::second_deriv) {
+        diag[0].setConstant(2.0);
+        upper[0].setZero();
+        rhs[0].setConstant(m_left_value);
+    } else if(m_left == spline::first_deriv) {
+        diag[0]=2.0*(x[1]-x[0]);
+        upper[0]=1.0*(x[1]-x[0]);
+        rhs[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+    } else {
+        assert(false);
+    }
+    if(m_right == spline::second_deriv) {
+        diag[n-1].setConstant(2.0);
+        lower[n-1].setZero();
+        rhs[n-1].setConstant(m_right_value);
+    } else if(m_right == spline::first_deriv) {
+        diag[n-1]=2.0*(x[n-1]-x[n-2]);
+        lower[n-1]=1.0*(x[n-1]-x[n-2]);
+        rhs[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+    } else {
+        assert(false);
+    }
+
+    // preconditioning: normalize row i so that a_ii=1
+    for(int i=0; i<n; i++) {
+        saved[i]=1.0/diag[i];
+        lower[i]*=saved[i];
+        upper[i]*=saved[i];
+        diag[i].setOnes();
+    }
+    // forward elimination
+    for(int k=0; k<n-1; k++) {
+        pack f=-lower[k+1]/diag[k];
+        lower[k+1]=-f;
+        diag[k+1]=diag[k+1]+f*upper[k];
+    }
+    // solve Ly=rhs, then Rb=y, with fixed_spline's zero-initialized sums
+    pack z[N];
+    z[0]=(rhs[0]*saved[0]) - 0.0;
+    for(int i=1; i<n; i++) {
+        z[i]=(rhs[i]*saved[i]) - (0.0 + lower[i]*z[i-1]);
+    }
+    pack* b=s.b;
+    b[n-1]=( z[n-1] - 0.0 ) / diag[n-1];
+    for(int i=n-2; i>=0; i--) {
+        b[i]=( z[i] - (0.0 + upper[i]*b[i+1]) ) / diag[i];
+    }
+
+    // calculate parameters a[] and c[] based on b[]
+    for(int i=0; i<n-1; i++) {
+        s.a[i]=1.0/3.0*(b[i+1]-b[i])/(x[i+1]-x[i]);
+        s.c[i]=(y[i+1]-y[i])/(x[i+1]-x[i])
+               - 1.0/3.0*(2.0*b[i]+b[i+1])*(x[i+1]-x[i]);
+    }
+
+    // for left extrapolation coefficients
+    if(m_force_linear_extrapolation==false) s.b0=b[0];
+    else                                    s.b0.setZero();
+
+    // for the right extrapolation coefficients
+    pack h=x[n-1]-x[n-2];
+    s.a[n-1].setZero();
+    s.c[n-1]=3.0*s.a[n-2]*h*h+2.0*b[n-2]*h+s.c[n-2];
+    if(m_force_linear_extrapolation==true)
+        b[n-1].setZero();
+}
+
+template<int N>
+void spline_batch<N>::eval(const double* xs, double* ys) const
+{
+    for(int j=0; j<m_size; j++) {
+        ys[j]=(*this)(j, xs[j]);
+    }
+}
+
+template<int N>
+double spline_batch<N>::operator() (int j, double x) const
+{
+    const int n=N;
+    assert(j>=0 && j<m_size);
+    const packed_splines& s=m_packs[j/pack_size];
+    const int l=j%pack_size;
+    int idx=0;
+    for(int i=1; i<n; i++) {
+        if(x>s.x[i][l]) idx=i;
+    }
+    double h=x-s.x[idx][l];
+    double interpol;
+    if(x<s.x[0][l]) {
+        // extrapolation to the left
+        interpol=(s.b0[l]*h + s.c[0][l])*h + s.y[0][l];
+    } else if(x>s.x[n-1][l]) {
+        // extrapolation to the right
+        interpol=(s.b[n-1][l]*h + s.c[n-1][l])*h + s.y[n-1][l];
+    } else {
+        // interpolation
+        interpol=((s.a[idx][l]*h + s.b[idx][l])*h + s.c[idx][l])*h + s.y[idx][l];
+    }
+    return interpol;
+}
+
+} // namespace tk
+
+} // namespace
+
+#endif /* SPLINE_BATCH_H */
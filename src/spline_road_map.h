@@ -0,0 +1,112 @@
+#ifndef SPLINE_ROAD_MAP_H
+#define SPLINE_ROAD_MAP_H
+
+#include <math.h>
+#include <array>
+#include <vector>
+#include "road_map.h"
+#include "spline.h"
+
+// Smooth version of RoadMap: x(s), y(s), dx(s) and dy(s) are cubic splines
+// through the waypoints instead of straight segments, so getXY() has no kinks
+// at the waypoints and the path needs no dense re-sampling downstream.
+//
+//   getXY(s, d)     = (x(s), y(s)) + d * (dx(s), dy(s))
+//   getFrenet(x, y) solves getXY(s, d) = (x, y) for s, d with Newton's
+//                   method, starting from a hint or from the linear map.
+//
+// A few waypoints from either end of the loop are repeated past the other
+// end before fitting, so the curve stays smooth across s = max_s.
+//
+// In the unnamed namespace like tk::spline, which it holds by value.
+namespace {
+
+class SplineRoadMap {
+ public:
+  SplineRoadMap() {}
+  SplineRoadMap(const std::vector<double> &maps_x,
+                const std::vector<double> &maps_y,
+                const std::vector<double> &maps_s,
+                const std::vector<double> &maps_dx,
+                const std::vector<double> &maps_dy, double max_s) {
+    build(maps_x, maps_y, maps_s, maps_dx, maps_dy, max_s);
+  }
+
+  void build(const std::vector<double> &maps_x,
+             const std::vector<double> &maps_y,
+             const std::vector<double> &maps_s,
+             const std::vector<double> &maps_dx,
+             const std::vector<double> &maps_dy, double max_s) {
+    linear_.build(maps_x, maps_y, maps_s, maps_dx, maps_dy, max_s);
+
+    int n = maps_x.size();
+    int wrap = std::min(kWrapPoints, n - 1);
+    std::vector<double> s, x, y, dx, dy;
+    for (int k = -wrap; k < n + wrap; k++) {
+      int i = (k + n) % n;
+      double lap = (k < 0) ? -max_s : (k >= n ? max_s : 0.0);
+      s.push_back(maps_s[i] + lap);
+      x.push_back(maps_x[i]);
+      y.push_back(maps_y[i]);
+      dx.push_back(maps_dx[i]);
+      dy.push_back(maps_dy[i]);
+    }
+    x_.set_points(s, x);
+    y_.set_points(s, y);
+    dx_.set_points(s, dx);
+    dy_.set_points(s, dy);
+  }
+
+  double maxS() const { return linear_.maxS(); }
+  const RoadMap &linear() const { return linear_; }
+
+  // Transform from Frenet s,d coordinates to Cartesian x,y.
+  std::array<double, 2> getXY(double s, double d) const {
+    s = linear_.wrapS(s);
+    std::array<double, 2> xy = {{x_(s) + d * dx_(s), y_(s) + d * dy_(s)}};
+    return xy;
+  }
+
+  // Transform from Cartesian x,y coordinates to Frenet s,d coordinates,
+  // seeded with the linear map's projection.
+  std::array<double, 2> getFrenet(double x, double y) const {
+    return getFrenet(x, y, linear_.getFrenet(x, y)[0]);
+  }
+
+  // Same, warm-started from s_hint (e.g. the object's s last frame).
+  std::array<double, 2> getFrenet(double x, double y, double s_hint) const {
+    double s = linear_.wrapS(s_hint);
+    double d = (x - x_(s)) * dx_(s) + (y - y_(s)) * dy_(s);
+    for (int iter = 0; iter < kMaxIterations; iter++) {
+      // Residual r = getXY(s, d) - (x, y) and its Jacobian
+      // J = [ x'(s) + d dx'(s),  dx(s) ]
+      //     [ y'(s) + d dy'(s),  dy(s) ]
+      double nx = dx_(s), ny = dy_(s);
+      double rx = x_(s) + d * nx - x;
+      double ry = y_(s) + d * ny - y;
+      double j00 = x_.deriv(1, s) + d * dx_.deriv(1, s);
+      double j10 = y_.deriv(1, s) + d * dy_.deriv(1, s);
+      double det = j00 * ny - nx * j10;
+      if (det == 0) break;
+      double step_s = (ny * rx - nx * ry) / det;
+      double step_d = (j00 * ry - j10 * rx) / det;
+      s -= step_s;
+      d -= step_d;
+      if (fabs(step_s) < kTolerance && fabs(step_d) < kTolerance) break;
+    }
+    std::array<double, 2> sd = {{linear_.wrapS(s), d}};
+    return sd;
+  }
+
+ private:
+  static const int kWrapPoints = 6;
+  static const int kMaxIterations = 6;
+  static constexpr double kTolerance = 1e-6;
+
+  RoadMap linear_;  // seeds the Newton iteration, wraps s
+  tk::spline x_, y_, dx_, dy_;
+};
+
+}  // namespace
+
+#endif  // SPLINE_ROAD_MAP_H
@@ -0,0 +1,234 @@
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include "json.hpp"
+#include "traffic_snapshot.h"
+
+// Array with its storage inline, for data that is refilled every frame
+// without touching the heap. Elements past the capacity are dropped.
+template <class T, int N>
+class FixedArray {
+ public:
+  static const int kCapacity = N;
+
+  FixedArray() : size_(0) {}
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == N; }
+  void clear() { size_ = 0; }
+  const T &operator[](int i) const { return items_[i]; }
+  T &operator[](int i) { return items_[i]; }
+  const T *begin() const { return items_; }
+  const T *end() const { return items_ + size_; }
+  T &back() { return items_[size_ - 1]; }
+
+  // Returns false, dropping v, if the array is full.
+  bool push_back(const T &v) {
+    if (size_ == N) return false;
+    items_[size_++] = v;
+    return true;
+  }
+
+ private:
+  T items_[N];
+  int size_;
+};
+
+// The data of one "telemetry" event from the simulator. Meant to be kept
+// and refilled for every message.
+//
+// The sensor fusion table holds kMaxCars cars, far more than the simulator
+// sends. Tools and benchmarks running synthetic traffic ask for up to
+// kMaxSyntheticCars; the table is allocated once either way, so the frame
+// itself stays small enough for the stack. The decoder writes the table
+// straight into the planner's columns. Cars that do not fit are dropped and
+// counted, so that the owner can grow the table and decode the message
+// again.
+struct TelemetryFrame {
+  static const int kMaxPathPoints = 256;
+  static const int kMaxCars = 1024;
+  static const int kMaxSyntheticCars = 16384;
+
+  explicit TelemetryFrame(int max_cars = kMaxCars) : sensor_fusion(max_cars) { clear(); }
+
+  // Main car's localization data
+  double x, y, s, d, yaw, speed;
+  // Previous path data given to the planner, and its end s and d values
+  FixedArray<double, kMaxPathPoints> previous_path_x, previous_path_y;
+  double end_path_s, end_path_d;
+  // Sensor fusion data: car_id, x, y, vx, vy, s and d columns
+  TrafficSnapshot sensor_fusion;
+  // Set if an array had more entries than fit; the extra ones are dropped.
+  bool truncated;
+  // Sensor fusion rows dropped because the table was full.
+  int dropped_cars;
+
+  void clear() {
+    x = y = s = d = yaw = speed = end_path_s = end_path_d = 0;
+    previous_path_x.clear();
+    previous_path_y.clear();
+    sensor_fusion.clear();
+    truncated = false;
+    dropped_cars = 0;
+  }
+};
+
+namespace telemetry {
+
+enum Field {
+  kUnknown = -1,
+  kX,
+  kY,
+  kS,
+  kD,
+  kYaw,
+  kSpeed,
+  kPreviousPathX,
+  kPreviousPathY,
+  kEndPathS,
+  kEndPathD,
+  kSensorFusion
+};
+
+// Perfect hash of the field names: FNV-1a with a seed that puts each name
+// in its own one of 32 slots. fieldOf() switches on the slot with one case
+// per name, so a new name that collides fails to compile.
+const uint32_t kHashSeed = 7;
+
+constexpr uint32_t hash(const char *s, size_t n, uint32_t h = kHashSeed) {
+  return n == 0 ? h : hash(s + 1, n - 1, (h ^ uint8_t(*s)) * 16777619u);
+}
+constexpr unsigned slot(const char *s, size_t n) { return hash(s, n) & 31; }
+template <size_t N>
+constexpr unsigned slot(const char (&name)[N]) {
+  return slot(name, N - 1);
+}
+
+inline Field fieldOf(const char *s, size_t n) {
+#define TELEMETRY_FIELD(name, field) \
+  case slot(name):                   \
+    return (n == sizeof(name) - 1 && memcmp(s, name, n) == 0) ? field : kUnknown
+  switch (slot(s, n)) {
+    TELEMETRY_FIELD("x", kX);
+    TELEMETRY_FIELD("y", kY);
+    TELEMETRY_FIELD("s", kS);
+    TELEMETRY_FIELD("d", kD);
+    TELEMETRY_FIELD("yaw", kYaw);
+    TELEMETRY_FIELD("speed", kSpeed);
+    TELEMETRY_FIELD("previous_path_x", kPreviousPathX);
+    TELEMETRY_FIELD("previous_path_y", kPreviousPathY);
+    TELEMETRY_FIELD("end_path_s", kEndPathS);
+    TELEMETRY_FIELD("end_path_d", kEndPathD);
+    TELEMETRY_FIELD("sensor_fusion", kSensorFusion);
+  }
+#undef TELEMETRY_FIELD
+  return kUnknown;
+}
+
+// SAX handler filling a TelemetryFrame from ["telemetry", {...}]. The
+// event name is at depth 1, the data's scalars at depth 2, the path arrays'
+// values at depth 3 and the sensor fusion values at depth 4.
+class FrameReader : public nlohmann::json::sax_handler {
+ public:
+  explicit FrameReader(TelemetryFrame *frame)
+      : frame_(frame), depth_(0), index_(0), field_(kUnknown), column_(-1) {}
+
+  bool isTelemetry() const { return index_ > 0 && depth_ == 0; }
+
+  bool string(const char *s, size_t n) {
+    // The event name comes first; anything but telemetry stops the parse.
+    if (depth_ == 1 && index_++ == 0) {
+      return n == 9 && memcmp(s, "telemetry", 9) == 0;
+    }
+    return true;
+  }
+  bool key(const char *s, size_t n) {
+    if (depth_ == 2) field_ = fieldOf(s, n);
+    return true;
+  }
+  bool number(double v) {
+    if (depth_ == 2) {
+      switch (field_) {
+        case kX: frame_->x = v; break;
+        case kY: frame_->y = v; break;
+        case kS: frame_->s = v; break;
+        case kD: frame_->d = v; break;
+        case kYaw: frame_->yaw = v; break;
+        case kSpeed: frame_->speed = v; break;
+        case kEndPathS: frame_->end_path_s = v; break;
+        case kEndPathD: frame_->end_path_d = v; break;
+        default: break;
+      }
+    } else if (depth_ == 3 && field_ == kPreviousPathX) {
+      frame_->truncated |= !frame_->previous_path_x.push_back(v);
+    } else if (depth_ == 3 && field_ == kPreviousPathY) {
+      frame_->truncated |= !frame_->previous_path_y.push_back(v);
+    } else if (depth_ == 4 && field_ == kSensorFusion && column_ >= 0 &&
+               column_ < TrafficSnapshot::kNumColumns) {
+      TrafficSnapshot &cars = frame_->sensor_fusion;
+      cars.set(cars.size() - 1, TrafficSnapshot::Column(column_++), v);
+    }
+    return true;
+  }
+  bool number_float(double v) { return number(v); }
+  bool number_integer(long long v) { return number(double(v)); }
+  bool number_unsigned(unsigned long long v) { return number(double(v)); }
+  bool start_object() {
+    depth_++;
+    return true;
+  }
+  bool end_object() {
+    depth_--;
+    return true;
+  }
+  bool start_array() {
+    if (++depth_ == 4 && field_ == kSensorFusion) {
+      // One car; it is dropped if the table is full.
+      bool added = frame_->sensor_fusion.addCar();
+      frame_->truncated |= !added;
+      frame_->dropped_cars += !added;
+      column_ = added ? 0 : -1;
+    }
+    return true;
+  }
+  bool end_array() {
+    if (depth_-- == 4 && field_ == kSensorFusion) {
+      // Fields missing from a short row are 0
+      TrafficSnapshot &cars = frame_->sensor_fusion;
+      while (column_ >= 0 && column_ < TrafficSnapshot::kNumColumns) {
+        cars.set(cars.size() - 1, TrafficSnapshot::Column(column_++), 0);
+      }
+    }
+    return true;
+  }
+
+ private:
+  TelemetryFrame *frame_;
+  int depth_;
+  int index_;     // strings seen at depth 1
+  Field field_;   // last key at depth 2
+  int column_;    // next sensor fusion column, -1 if the car is dropped
+};
+
+}  // namespace telemetry
+
+// Decodes the payload of a Socket.IO event, ["telemetry", {...}], straight
+// into frame, without building a JSON DOM and without allocating. Returns
+// false if the payload is not a telemetry event or is not valid JSON.
+inline bool decodeTelemetry(const char *first, const char *last,
+                            TelemetryFrame *frame) {
+  frame->clear();
+  telemetry::FrameReader reader(frame);
+  try {
+    return nlohmann::json::sax_parse(first, last, &reader) && reader.isTelemetry();
+  } catch (const std::invalid_argument &) {
+    return false;
+  }
+}
+
+#endif  // TELEMETRY_FRAME_H
@@ -0,0 +1,560 @@
+#ifndef TILED_ROAD_MAP_H
+#define TILED_ROAD_MAP_H
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "map_file.h"
+#include "road_map.h"
+#include "waypoint_index.h"
+
+// Tiled road map file, for routes too long to keep in memory. The route is
+// cut into tiles of a fixed s length and every segment is stored in the tile
+// its start falls in:
+//
+//   header      MapTileHeader
+//   directory   MapTileEntry[num_tiles]
+//   tiles       RoadSegment[num_segments + 1] per tile
+//
+// The extra segment after a tile's own is the one starting where the tile's
+// last segment ends, i.e. it provides the end point. The directory and each
+// tile start on a 64 byte boundary; all values are little endian.
+struct MapTileHeader {
+  char magic[8];  // "PPTILES" followed by a zero
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t file_size;
+  double max_s;  // route length; a closed route wraps back to 0 here
+  double tile_length;
+  uint64_t num_segments;
+  uint32_t num_tiles;
+  uint32_t closed;  // 1 if the last waypoint connects back to the first
+  uint64_t directory_offset;
+};
+
+struct MapTileEntry {
+  uint64_t offset;         // of the tile's segments, from the start of the file
+  uint32_t first_segment;  // route index of the tile's first segment
+  uint32_t num_segments;   // 0 if no segment starts in the tile
+  double s_begin;          // s at the start of the tile's first segment
+  double s_end;            // s at the end of its last segment
+};
+
+// Road map read from a tiled map file a few tiles at a time. Only the header
+// and the tile directory (32 bytes per tile) stay in memory; tiles are read
+// when a lookup needs them and kept in a small LRU cache, so memory use does
+// not depend on the length of the route. prefetch() loads the tiles at and
+// ahead of the car's s on a background thread, so that lookups along the
+// route do not wait for the disk.
+//
+// Lookups cross tile boundaries transparently. Like the other maps, a
+// TiledRoadMap is meant to be used from one thread; only the prefetching
+// runs in the background.
+class TiledRoadMap {
+ public:
+  static const uint32_t kVersion = 1;
+  static const uint64_t kAlignment = 64;
+
+  // cache_tiles: number of decoded tiles kept, at least 3 (the tile a
+  // lookup is in and both its neighbours).
+  explicit TiledRoadMap(size_t cache_tiles = 4)
+      : fd_(-1),
+        capacity_(std::max<size_t>(cache_tiles, 3)),
+        first_tile_(0),
+        loading_(-1),
+        stop_(false),
+        tile_loads_(0),
+        blocking_loads_(0) {
+    memset(&header_, 0, sizeof(header_));
+  }
+  ~TiledRoadMap() { close(); }
+
+  // True if the file at path starts with the tiled map file magic.
+  static bool isTileFile(const std::string &path) {
+    char magic[8] = {0};
+    std::ifstream in(path.c_str(), std::ios::binary);
+    in.read(magic, sizeof(magic));
+    return in && memcmp(magic, kMagic(), sizeof(magic)) == 0;
+  }
+
+  bool open(const std::string &path, std::string *error = 0) {
+    close();
+    if (!hostIsLittleEndian()) return fail(error, "big endian hosts are not supported");
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) return fail(error, "cannot open " + path);
+    std::string why;
+    if (!readDirectory(&why)) {
+      close();
+      return fail(error, path + ": " + why);
+    }
+    stop_ = false;
+    worker_ = std::thread(&TiledRoadMap::prefetchLoop, this);
+    return true;
+  }
+
+  void close() {
+    if (worker_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      worker_.join();
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+    memset(&header_, 0, sizeof(header_));
+    std::vector<MapTileEntry>().swap(directory_);
+    current_.reset();
+    lru_.clear();
+    where_.clear();
+    requests_.clear();
+  }
+
+  bool isOpen() const { return fd_ >= 0; }
+  double maxS() const { return header_.max_s; }
+  double tileLength() const { return header_.tile_length; }
+  int numTiles() const { return directory_.size(); }
+  bool closed() const { return header_.closed != 0; }
+
+  size_t cachedTiles() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+  }
+  // Tiles read so far, and how many of those a lookup had to wait for.
+  long tileLoads() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tile_loads_;
+  }
+  long blockingLoads() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocking_loads_;
+  }
+
+  // s wrapped into [0, max_s) on a closed route, unchanged on an open one.
+  double wrapS(double s) const {
+    if (!closed() || (s >= 0 && s < header_.max_s)) return s;
+    s = fmod(s, header_.max_s);
+    return (s < 0) ? s + header_.max_s : s;
+  }
+
+  // Starts loading the tiles at s and one tile length ahead of it, if they
+  // are not cached yet. Call with the car's s once per frame.
+  void prefetch(double s) {
+    int here = tileAtS(wrapS(s));
+    int ahead = tileAtS(wrapS(s + header_.tile_length));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      request(here);
+      request(ahead);
+    }
+    wake_.notify_one();
+  }
+
+  // Transform from Frenet s,d coordinates to Cartesian x,y.
+  std::array<double, 2> getXY(double s, double d) {
+    s = wrapS(s);
+    const Tile &tile = tileContaining(s);
+    const RoadSegment &seg = tile.segments[tile.segmentAtS(s)];
+    double seg_s = s - seg.s;
+    std::array<double, 2> xy = {{seg.x + seg_s * seg.tx + d * seg.nx,
+                                 seg.y + seg_s * seg.ty + d * seg.ny}};
+    return xy;
+  }
+
+  // Transform from Cartesian x,y coordinates to Frenet s,d coordinates,
+  // searching the tile at s_hint (e.g. the car's s) and its neighbours.
+  std::array<double, 2> getFrenet(double x, double y, double s_hint) {
+    int t = tileAtS(wrapS(s_hint));
+    std::vector<TilePtr> tiles;
+    for (int k = -1; k <= 1; k++) {
+      int u = neighbour(t, k);
+      if (u < 0 || directory_[u].num_segments == 0) continue;
+      bool seen = false;
+      for (size_t j = 0; j < tiles.size(); j++) seen |= (tiles[j]->id == u);
+      if (!seen) tiles.push_back(tile(u));
+    }
+    return frenetIn(tiles, x, y);
+  }
+
+  // Same, searching only the tiles that are in the cache.
+  std::array<double, 2> getFrenet(double x, double y) {
+    std::vector<TilePtr> tiles;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tiles.assign(lru_.begin(), lru_.end());
+    }
+    if (tiles.empty()) {
+      tiles.push_back(tile(first_tile_));
+    }
+    return frenetIn(tiles, x, y);
+  }
+
+  // Builds the segments for wp and writes them to path as a tiled map of
+  // tile_length long tiles. An open route has one segment less than a
+  // closed one and its s does not wrap around.
+  static bool write(const std::string &path, const MapWaypoints &wp,
+                    double max_s, double tile_length, bool closed,
+                    std::string *error = 0) {
+    if (!hostIsLittleEndian()) return fail(error, "big endian hosts are not supported");
+    if (wp.size() < 2) return fail(error, "a map needs at least two waypoints");
+    if (!(tile_length > 0)) return fail(error, "tile length must be positive");
+    RoadMap road_map(wp.x, wp.y, wp.s, wp.dx, wp.dy, max_s);
+    int n = road_map.size();
+    int num_segments = closed ? n : n - 1;
+
+    MapTileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic(), sizeof(h.magic));
+    h.version = kVersion;
+    h.header_size = sizeof(MapTileHeader);
+    h.max_s = max_s;
+    h.tile_length = tile_length;
+    h.num_segments = num_segments;
+    h.num_tiles = tileOf(road_map.segment(num_segments - 1).s, tile_length) + 1;
+    h.closed = closed ? 1 : 0;
+    h.directory_offset = align(sizeof(MapTileHeader));
+
+    std::vector<MapTileEntry> directory(h.num_tiles);
+    memset(&directory[0], 0, directory.size() * sizeof(MapTileEntry));
+    uint64_t offset = align(h.directory_offset + directory.size() * sizeof(MapTileEntry));
+    for (int i = 0; i < num_segments;) {
+      const RoadSegment &first = road_map.segment(i);
+      int t = tileOf(first.s, tile_length);
+      int end = i + 1;
+      while (end < num_segments &&
+             tileOf(road_map.segment(end).s, tile_length) == t) {
+        end++;
+      }
+      const RoadSegment &last = road_map.segment(end - 1);
+      MapTileEntry &e = directory[t];
+      e.offset = offset;
+      e.first_segment = i;
+      e.num_segments = end - i;
+      e.s_begin = first.s;
+      e.s_end = last.s + last.length;
+      offset = align(offset + (e.num_segments + 1) * sizeof(RoadSegment));
+      i = end;
+    }
+    h.file_size = offset;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return fail(error, "cannot create " + path);
+    static const char zeros[kAlignment] = {0};
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(zeros, h.directory_offset - sizeof(h));
+    out.write(reinterpret_cast<const char *>(&directory[0]),
+              directory.size() * sizeof(MapTileEntry));
+    uint64_t pos = h.directory_offset + directory.size() * sizeof(MapTileEntry);
+    for (size_t t = 0; t < directory.size(); t++) {
+      const MapTileEntry &e = directory[t];
+      if (e.num_segments == 0) continue;
+      out.write(zeros, e.offset - pos);
+      for (uint32_t k = 0; k <= e.num_segments; k++) {
+        const RoadSegment &seg = road_map.segment((e.first_segment + k) % n);
+        out.write(reinterpret_cast<const char *>(&seg), sizeof(seg));
+      }
+      pos = e.offset + (e.num_segments + 1) * sizeof(RoadSegment);
+    }
+    out.write(zeros, h.file_size - pos);
+    if (!out) return fail(error, "error writing " + path);
+    return true;
+  }
+
+ private:
+  static_assert(sizeof(MapTileHeader) == 64, "MapTileHeader layout");
+  static_assert(sizeof(MapTileEntry) == 32, "MapTileEntry layout");
+  static_assert(sizeof(RoadSegment) == 64, "RoadSegment layout");
+
+  // One decoded tile: its segments (plus the end point record) and a
+  // spatial index over them.
+  struct Tile {
+    int id;
+    double s_begin, s_end;
+    std::vector<RoadSegment> segments;
+    std::vector<double> seg_s;
+    WaypointIndex index;
+
+    // Local index of the segment containing s, clamped to the tile.
+    int segmentAtS(double s) const {
+      int i = int(std::upper_bound(seg_s.begin(), seg_s.end(), s) - seg_s.begin()) - 1;
+      return std::max(i, 0);
+    }
+  };
+  typedef std::shared_ptr<const Tile> TilePtr;
+
+  TiledRoadMap(const TiledRoadMap &);
+  TiledRoadMap &operator=(const TiledRoadMap &);
+
+  static const char *kMagic() { return "PPTILES\0"; }
+  static uint64_t align(uint64_t n) {
+    return (n + kAlignment - 1) / kAlignment * kAlignment;
+  }
+  static int tileOf(double s, double tile_length) {
+    return std::max(0, int(s / tile_length));
+  }
+  static bool hostIsLittleEndian() {
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t *>(&one) == 1;
+  }
+  static bool fail(std::string *error, const std::string &why) {
+    if (error) *error = why;
+    return false;
+  }
+
+  bool readAt(void *dst, uint64_t bytes, uint64_t offset) const {
+    char *p = static_cast<char *>(dst);
+    while (bytes > 0) {
+      ssize_t got = pread(fd_, p, bytes, offset);
+      if (got <= 0) return false;
+      p += got;
+      bytes -= got;
+      offset += got;
+    }
+    return true;
+  }
+
+  // Reads and checks the header and the tile directory.
+  bool readDirectory(std::string *why) {
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || !readAt(&header_, sizeof(header_), 0)) {
+      *why = "too small to be a tiled map file";
+      return false;
+    }
+    const MapTileHeader &h = header_;
+    if (memcmp(h.magic, kMagic(), sizeof(h.magic)) != 0) {
+      *why = "not a tiled map file";
+      return false;
+    }
+    if (h.version != kVersion || h.header_size != sizeof(MapTileHeader)) {
+      *why = "unsupported tiled map file version";
+      return false;
+    }
+    if (h.file_size != uint64_t(st.st_size)) {
+      *why = "truncated tiled map file";
+      return false;
+    }
+    if (h.num_tiles == 0 || !(h.tile_length > 0) || h.num_segments == 0 ||
+        h.directory_offset > h.file_size ||
+        h.num_tiles > (h.file_size - h.directory_offset) / sizeof(MapTileEntry)) {
+      *why = "corrupt header";
+      return false;
+    }
+    directory_.resize(h.num_tiles);
+    if (!readAt(&directory_[0], directory_.size() * sizeof(MapTileEntry),
+                h.directory_offset)) {
+      *why = "cannot read the tile directory";
+      return false;
+    }
+    first_tile_ = -1;
+    for (size_t t = 0; t < directory_.size(); t++) {
+      const MapTileEntry &e = directory_[t];
+      if (e.num_segments == 0) continue;
+      if (e.offset % kAlignment != 0 || e.offset > h.file_size ||
+          e.num_segments + 1 > (h.file_size - e.offset) / sizeof(RoadSegment) ||
+          uint64_t(e.first_segment) + e.num_segments > h.num_segments) {
+        *why = "corrupt tile directory";
+        return false;
+      }
+      if (first_tile_ < 0) first_tile_ = t;
+    }
+    if (first_tile_ < 0) {
+      *why = "no tiles";
+      return false;
+    }
+    return true;
+  }
+
+  // Index of the tile holding the segment that contains the (already
+  // wrapped) s. The tile s falls in may start with the tail of a segment
+  // from an earlier tile, or hold no segment at all.
+  int tileAtS(double s) const {
+    int last = int(directory_.size()) - 1;
+    int t = std::min(tileOf(s, header_.tile_length), last);
+    while (t > first_tile_ &&
+           (directory_[t].num_segments == 0 || s < directory_[t].s_begin)) {
+      t--;
+    }
+    return std::max(t, first_tile_);
+  }
+
+  // The k-th tile after t (k may be negative), or -1 past the end of an
+  // open route.
+  int neighbour(int t, int k) const {
+    int n = directory_.size();
+    int u = t + k;
+    if (closed()) return ((u % n) + n) % n;
+    return (u >= 0 && u < n) ? u : -1;
+  }
+
+  // Tile for a lookup at the (already wrapped) s. The last tile used is
+  // checked before going through the cache.
+  const Tile &tileContaining(double s) {
+    if (!current_ || s < current_->s_begin || s >= current_->s_end) {
+      current_ = tile(tileAtS(s));
+    }
+    return *current_;
+  }
+
+  TilePtr tile(int t) {
+    if (current_ && current_->id == t) return current_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (loading_ == t) loaded_.wait(lock);
+    std::unordered_map<int, std::list<TilePtr>::iterator>::iterator it = where_.find(t);
+    if (it != where_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return *it->second;
+    }
+    // Not prefetched in time; load it here instead.
+    requests_.erase(std::remove(requests_.begin(), requests_.end(), t),
+                    requests_.end());
+    blocking_loads_++;
+    lock.unlock();
+    TilePtr loaded = load(t);
+    lock.lock();
+    return insert(loaded);
+  }
+
+  // Reads and decodes tile t; safe to call without holding mutex_.
+  TilePtr load(int t) const {
+    const MapTileEntry &e = directory_[t];
+    std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+    tile->id = t;
+    tile->s_begin = e.s_begin;
+    tile->s_end = e.s_end;
+    tile->segments.resize(e.num_segments + 1);
+    if (e.num_segments == 0 ||
+        !readAt(&tile->segments[0], tile->segments.size() * sizeof(RoadSegment),
+                e.offset)) {
+      // Leaves an empty tile; lookups on it clamp to its segment 0.
+      tile->segments.assign(1, RoadSegment());
+    }
+    std::vector<double> xs, ys;
+    for (size_t k = 0; k < tile->segments.size(); k++) {
+      const RoadSegment &seg = tile->segments[k];
+      if (k + 1 < tile->segments.size()) tile->seg_s.push_back(seg.s);
+      xs.push_back(seg.x);
+      ys.push_back(seg.y);
+    }
+    tile->index.build(xs, ys, false);
+    return tile;
+  }
+
+  // Adds a tile to the cache, evicting the least recently used ones. The
+  // tile may have been loaded meanwhile by the other thread; that copy
+  // wins. Called with mutex_ held.
+  TilePtr insert(const TilePtr &tile) {
+    tile_loads_++;
+    std::unordered_map<int, std::list<TilePtr>::iterator>::iterator it =
+        where_.find(tile->id);
+    if (it != where_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return *it->second;
+    }
+    lru_.push_front(tile);
+    where_[tile->id] = lru_.begin();
+    while (lru_.size() > capacity_) {
+      where_.erase(lru_.back()->id);
+      lru_.pop_back();
+    }
+    return tile;
+  }
+
+  // Queues tile t for the prefetch thread. Called with mutex_ held.
+  void request(int t) {
+    if (t == loading_ || where_.count(t) ||
+        std::find(requests_.begin(), requests_.end(), t) != requests_.end()) {
+      return;
+    }
+    requests_.push_back(t);
+  }
+
+  void prefetchLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!stop_ && requests_.empty()) wake_.wait(lock);
+      if (stop_) return;
+      int t = requests_.front();
+      requests_.pop_front();
+      if (where_.count(t)) continue;
+      loading_ = t;
+      lock.unlock();
+      TilePtr loaded = load(t);
+      lock.lock();
+      insert(loaded);
+      loading_ = -1;
+      loaded_.notify_all();
+    }
+  }
+
+  // Frenet s,d of x,y on the closest segment in any of the tiles.
+  std::array<double, 2> frenetIn(const std::vector<TilePtr> &tiles, double x,
+                                 double y) const {
+    const RoadSegment *best = 0;
+    double best_dist2 = HUGE_VAL;
+    for (size_t k = 0; k < tiles.size(); k++) {
+      const Tile &tile = *tiles[k];
+      int i = tile.index.closestSegment(x, y);
+      if (i < 0) continue;
+      const RoadSegment &seg = tile.segments[i];
+      double px = x - seg.x;
+      double py = y - seg.y;
+      double t = std::min(std::max(px * seg.tx + py * seg.ty, 0.0), seg.length);
+      double ex = px - t * seg.tx;
+      double ey = py - t * seg.ty;
+      double dist2 = ex * ex + ey * ey;
+      if (dist2 < best_dist2) {
+        best_dist2 = dist2;
+        best = &seg;
+      }
+    }
+    if (!best) {
+      std::array<double, 2> none = {{0.0, 0.0}};
+      return none;
+    }
+    double px = x - best->x;
+    double py = y - best->y;
+    std::array<double, 2> sd = {{wrapS(best->s + px * best->tx + py * best->ty),
+                                 px * best->nx + py * best->ny}};
+    return sd;
+  }
+
+  int fd_;
+  MapTileHeader header_;
+  std::vector<MapTileEntry> directory_;
+  size_t capacity_;
+  int first_tile_;
+  TilePtr current_;  // last tile a lookup used
+
+  // Shared with the prefetch thread.
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;    // a tile was requested, or stop_
+  std::condition_variable loaded_;  // the prefetch thread finished a tile
+  std::list<TilePtr> lru_;          // most recently used first
+  std::unordered_map<int, std::list<TilePtr>::iterator> where_;
+  std::deque<int> requests_;
+  int loading_;
+  bool stop_;
+  long tile_loads_;
+  long blocking_loads_;
+  std::thread worker_;
+};
+
+#endif  // TILED_ROAD_MAP_H
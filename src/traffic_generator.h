@@ -0,0 +1,249 @@
+#ifndef TRAFFIC_GENERATOR_H
+#define TRAFFIC_GENERATOR_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+#include "road_map.h"
+
+// Synthetic traffic for scale testing the planner: any number of cars on
+// the road around the ego car, in the simulator's sensor fusion schema
+// [id, x, y, vx, vy, s, d], placed with RoadMap::getXY so that x, y and
+// s, d agree on the map the planner uses.
+//
+// The cars of each lane sit in evenly spaced slots, jittered by up to 40%
+// of the gap, over a stretch of road centered on the ego car whose length
+// follows from the density. Each keeps its lane and a speed drawn around
+// the mean; they do not react to each other or to the ego car.
+//
+// Everything follows from the options: the random numbers come from
+// std::mt19937, whose sequence the standard fixes, and are turned into
+// uniform and normal variates here rather than by <random>'s
+// distributions, which differ between standard libraries.
+class TrafficGenerator {
+ public:
+  static const int kLanes = 3;
+  static constexpr double kLaneWidth = 4.0;
+
+  struct Options {
+    uint32_t seed;
+    int cars;
+    // Cars per km of road, over all lanes. 0 spreads them over the loop.
+    double density;
+    // Share of the cars in each lane, from the left; need not sum to 1.
+    std::array<double, kLanes> lane_weights;
+    // Mean speed and the standard deviation around it, m/s
+    double speed, speed_spread;
+    // Road kept free of cars on either side of the ego car at reset(), m,
+    // so that it can get up to speed first. The cars keep their density
+    // around it.
+    double clearance;
+
+    Options()
+        : seed(1), cars(12), density(0), lane_weights{{1, 1, 1}}, speed(20),
+          speed_spread(2.5), clearance(0) {}
+  };
+
+  typedef std::array<double, 7> Row;
+
+  TrafficGenerator(const RoadMap *road, const Options &options)
+      : road_(road), options_(options) {}
+
+  // Places the cars around ego_s and draws their speeds, from the seed.
+  void reset(double ego_s) {
+    std::mt19937 rng(options_.seed);
+    double max_s = road_->maxS();
+    double clearance = std::max(0.0, std::min(options_.clearance, max_s / 4));
+    double length = max_s - 2 * clearance;
+    if (options_.density > 0) length = std::min(length, options_.cars * 1000.0 / options_.density);
+    // The cars' stretch of road, with the clearance cut out of its middle
+    double start = ego_s - clearance - length / 2;
+
+    std::array<int, kLanes> counts = laneCounts();
+    cars_.clear();
+    for (int lane = 0; lane < kLanes; lane++) {
+      double gap = length / std::max(1, counts[lane]);
+      for (int k = 0; k < counts[lane]; k++) {
+        Car car;
+        double s = start + (k + 0.5 + 0.8 * (uniform(rng) - 0.5)) * gap;
+        car.s = wrap(s < ego_s - clearance ? s : s + 2 * clearance);
+        car.d = (lane + 0.5) * kLaneWidth;
+        car.speed = std::max(0.0, options_.speed + options_.speed_spread * normal(rng));
+        cars_.push_back(car);
+      }
+    }
+    update();
+  }
+
+  // Moves every car dt seconds along its lane.
+  void step(double dt) {
+    for (Car &car : cars_) car.s = wrap(car.s + car.speed * dt);
+    update();
+  }
+
+  const std::vector<Row> &rows() const { return rows_; }
+  const Options &options() const { return options_; }
+
+ private:
+  struct Car {
+    double s, d, speed;
+  };
+
+  // Cars per lane in proportion to the weights, by largest remainder.
+  std::array<int, kLanes> laneCounts() const {
+    std::array<int, kLanes> counts;
+    std::array<double, kLanes> rest;
+    double total = 0;
+    for (double w : options_.lane_weights) total += std::max(0.0, w);
+    int placed = 0;
+    for (int i = 0; i < kLanes; i++) {
+      double share = total > 0 ? options_.cars * std::max(0.0, options_.lane_weights[i]) / total
+                               : double(options_.cars) / kLanes;
+      counts[i] = int(share);
+      rest[i] = share - counts[i];
+      placed += counts[i];
+    }
+    for (; placed < options_.cars; placed++) {
+      int best = 0;
+      for (int i = 1; i < kLanes; i++) {
+        if (rest[i] > rest[best]) best = i;
+      }
+      counts[best]++;
+      rest[best] = -1;
+    }
+    return counts;
+  }
+
+  void update() {
+    rows_.resize(cars_.size());
+    for (size_t i = 0; i < cars_.size(); i++) {
+      const Car &car = cars_[i];
+      std::array<double, 2> p = road_->getXY(car.s, car.d);
+      std::array<double, 2> q = road_->getXY(car.s + 1, car.d);
+      double tx = q[0] - p[0], ty = q[1] - p[1];
+      double norm = sqrt(tx * tx + ty * ty);
+      if (norm > 0) {
+        tx /= norm;
+        ty /= norm;
+      }
+      Row row = {{double(i), p[0], p[1], car.speed * tx, car.speed * ty, car.s, car.d}};
+      rows_[i] = row;
+    }
+  }
+
+  double wrap(double s) const {
+    double max_s = road_->maxS();
+    s = fmod(s, max_s);
+    return s < 0 ? s + max_s : s;
+  }
+
+  // In [0, 1), from 53 bits of two draws
+  static double uniform(std::mt19937 &rng) {
+    uint32_t a = rng() >> 5, b = rng() >> 6;
+    return (a * 67108864.0 + b) / 9007199254740992.0;
+  }
+  // Standard normal, by Box-Muller
+  static double normal(std::mt19937 &rng) {
+    double u = uniform(rng), v = uniform(rng);
+    return sqrt(-2 * log(1 - u)) * cos(2 * M_PI * v);
+  }
+
+  const RoadMap *road_;
+  Options options_;
+  std::vector<Car> cars_;
+  std::vector<Row> rows_;
+};
+
+// The ego car's part of a telemetry message, as the simulator reports it.
+struct EgoState {
+  double x, y, s, d;
+  double yaw;    // degrees
+  double speed;  // mph
+  std::vector<double> previous_path_x, previous_path_y;
+  double end_path_s, end_path_d;
+
+  // Cruising at mph at s, d, with path_points points of its previous path
+  // left along the lane.
+  static EgoState cruising(const RoadMap &road, double s, double d, double mph,
+                           int path_points) {
+    const double step = mph / 2.24 * 0.02;
+    EgoState ego;
+    std::array<double, 2> p = road.getXY(s, d), q = road.getXY(s + 1, d);
+    ego.x = p[0];
+    ego.y = p[1];
+    ego.s = s;
+    ego.d = d;
+    ego.yaw = atan2(q[1] - p[1], q[0] - p[0]) * 180 / M_PI;
+    ego.speed = mph;
+    for (int i = 1; i <= path_points; i++) {
+      std::array<double, 2> xy = road.getXY(s + i * step, d);
+      ego.previous_path_x.push_back(xy[0]);
+      ego.previous_path_y.push_back(xy[1]);
+    }
+    ego.end_path_s = fmod(s + path_points * step, road.maxS());
+    ego.end_path_d = d;
+    return ego;
+  }
+};
+
+namespace traffic {
+
+inline void appendNumber(std::string *out, double v) {
+  char buf[32];
+  out->append(buf, snprintf(buf, sizeof(buf), "%.10g", v));
+}
+
+inline void appendArray(std::string *out, const std::vector<double> &v) {
+  out->push_back('[');
+  for (size_t i = 0; i < v.size(); i++) {
+    if (i) out->push_back(',');
+    appendNumber(out, v[i]);
+  }
+  out->push_back(']');
+}
+
+}  // namespace traffic
+
+// Writes the simulator's 42["telemetry",{...}] message for the ego car and
+// the sensor fusion rows into *out.
+inline void telemetryMessage(const EgoState &ego, const std::vector<std::array<double, 7> > &cars,
+                             std::string *out) {
+  using traffic::appendNumber;
+  out->assign("42[\"telemetry\",{\"x\":");
+  appendNumber(out, ego.x);
+  out->append(",\"y\":");
+  appendNumber(out, ego.y);
+  out->append(",\"yaw\":");
+  appendNumber(out, ego.yaw);
+  out->append(",\"speed\":");
+  appendNumber(out, ego.speed);
+  out->append(",\"s\":");
+  appendNumber(out, ego.s);
+  out->append(",\"d\":");
+  appendNumber(out, ego.d);
+  out->append(",\"previous_path_x\":");
+  traffic::appendArray(out, ego.previous_path_x);
+  out->append(",\"previous_path_y\":");
+  traffic::appendArray(out, ego.previous_path_y);
+  out->append(",\"end_path_s\":");
+  appendNumber(out, ego.end_path_s);
+  out->append(",\"end_path_d\":");
+  appendNumber(out, ego.end_path_d);
+  out->append(",\"sensor_fusion\":[");
+  for (size_t i = 0; i < cars.size(); i++) {
+    out->append(i ? ",[" : "[");
+    for (int k = 0; k < 7; k++) {
+      if (k) out->push_back(',');
+      appendNumber(out, cars[i][k]);
+    }
+    out->push_back(']');
+  }
+  out->append("]}]");
+}
+
+#endif  // TRAFFIC_GENERATOR_H
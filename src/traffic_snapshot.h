@@ -0,0 +1,108 @@
+#ifndef TRAFFIC_SNAPSHOT_H
+#define TRAFFIC_SNAPSHOT_H
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include "Eigen-3.3/Eigen/Core"
+
+// The sensor fusion table of one frame as a struct of arrays: one
+// contiguous, aligned column per field instead of one row per vehicle, plus
+// the per-vehicle values the planner derives from them. update() computes
+// those for all vehicles in one pass of Eigen array expressions, which the
+// compiler vectorizes.
+//
+// The telemetry decoder writes each value straight into its column with
+// addCar() and set(), so the table is never held as rows. Columns keep
+// their capacity across frames; addCar() drops vehicles past it, and only
+// reserve() and assign() allocate.
+class TrafficSnapshot {
+ public:
+  // The sensor fusion fields, in the simulator's order
+  enum Column { kId, kX, kY, kVx, kVy, kS, kD, kNumColumns };
+
+  explicit TrafficSnapshot(int capacity = 0) : size_(0) { reserve(capacity); }
+
+  int capacity() const { return int(columns_[kId].size()); }
+
+  // Grows the columns to hold at least n vehicles, keeping their values.
+  void reserve(int n) {
+    if (n <= capacity()) return;
+    for (Eigen::ArrayXd &c : columns_) c.conservativeResize(n);
+    speed_.resize(n);
+    projected_s_.resize(n);
+    scratch_.resize(n);
+    lane_.resize(n);
+  }
+
+  void clear() { size_ = 0; }
+
+  // Appends a vehicle whose fields are to be filled in with set(). Returns
+  // false, adding nothing, if the columns are full.
+  bool addCar() {
+    if (size_ == capacity()) return false;
+    size_++;
+    return true;
+  }
+  void set(int i, Column column, double v) { columns_[column][i] = v; }
+
+  // Copies n sensor fusion rows, [id, x, y, vx, vy, s, d] each, into the
+  // columns, growing them if needed. The derived values are stale until
+  // the next update().
+  void assign(const std::array<double, 7> *rows, int n) {
+    if (n > capacity()) reserve(std::max(n, 2 * capacity()));
+    size_ = n;
+    for (int i = 0; i < n; i++) {
+      for (int c = 0; c < kNumColumns; c++) columns_[c][i] = rows[i][c];
+    }
+  }
+
+  // Speed, lane and s after `horizon` seconds at constant speed, for every
+  // vehicle. A vehicle's lane is i if d is strictly between i and i + 1
+  // lane widths from the road's center line, -1 if it is on a lane line or
+  // left of the center line.
+  void update(double horizon, double lane_width) {
+    int n = size_;
+    const Eigen::ArrayXd &vx = columns_[kVx], &vy = columns_[kVy];
+    const Eigen::ArrayXd &s = columns_[kS], &d = columns_[kD];
+    speed_.head(n) = (vx.head(n).square() + vy.head(n).square()).sqrt();
+    projected_s_.head(n) = s.head(n) + horizon * speed_.head(n);
+    // For d > 0 truncating d / lane_width gives the lane; it is on a lane
+    // line if the truncation was exact.
+    Eigen::ArrayXd::SegmentReturnType lanes = scratch_.head(n);
+    lanes = d.head(n) * (1.0 / lane_width);
+    lane_.head(n) = lanes.cast<int>();
+    lane_.head(n) = (d.head(n) > 0 && lane_.head(n).cast<double>() != lanes)
+                        .select(lane_.head(n), -1);
+  }
+
+  // A vehicle's s after `horizon` seconds, as update() computes it for
+  // every vehicle, for code that needs just a few.
+  double projectS(int i, double horizon) const {
+    double vx = columns_[kVx][i], vy = columns_[kVy][i];
+    return columns_[kS][i] + horizon * sqrt(vx * vx + vy * vy);
+  }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  double get(int i, Column column) const { return columns_[column][i]; }
+  double id(int i) const { return columns_[kId][i]; }
+  double x(int i) const { return columns_[kX][i]; }
+  double y(int i) const { return columns_[kY][i]; }
+  double vx(int i) const { return columns_[kVx][i]; }
+  double vy(int i) const { return columns_[kVy][i]; }
+  double s(int i) const { return columns_[kS][i]; }
+  double d(int i) const { return columns_[kD][i]; }
+  double speed(int i) const { return speed_[i]; }
+  double projectedS(int i) const { return projected_s_[i]; }
+  int lane(int i) const { return lane_[i]; }
+
+ private:
+  int size_;
+  Eigen::ArrayXd columns_[kNumColumns];
+  Eigen::ArrayXd speed_, projected_s_, scratch_;
+  Eigen::ArrayXi lane_;
+};
+
+#endif  // TRAFFIC_SNAPSHOT_H
@@ -0,0 +1,282 @@
+#ifndef WAYPOINT_INDEX_H
+#define WAYPOINT_INDEX_H
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "map_array.h"
+
+// Uniform grid over the segments of a waypoint map, built once at startup.
+// Each segment (waypoint i -> i+1, wrapping around on a closed track) is
+// listed in every cell its bounding box touches; empty cells are not stored. Queries walk rings of
+// cells outward from the query point and stop as soon as no unvisited cell
+// can hold anything closer than the best candidate found so far, so a query
+// near the road touches one or two cells regardless of map size.
+class WaypointIndex {
+ public:
+  WaypointIndex() {}
+  WaypointIndex(const std::vector<double> &maps_x,
+                const std::vector<double> &maps_y, bool closed = true) {
+    build(maps_x, maps_y, closed);
+  }
+
+  void build(const std::vector<double> &maps_x,
+             const std::vector<double> &maps_y, bool closed = true) {
+    int n = maps_x.size();
+    std::vector<Point> pts(n);
+    double max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+    min_x_ = HUGE_VAL;
+    min_y_ = HUGE_VAL;
+    for (int i = 0; i < n; i++) {
+      pts[i].x = maps_x[i];
+      pts[i].y = maps_y[i];
+      min_x_ = std::min(min_x_, maps_x[i]);
+      min_y_ = std::min(min_y_, maps_y[i]);
+      max_x = std::max(max_x, maps_x[i]);
+      max_y = std::max(max_y, maps_y[i]);
+    }
+    num_segments_ = (n < 2) ? 0 : (closed ? n : n - 1);
+
+    // Cells of about two segment lengths keep a query near the road to a
+    // handful of candidates. Only occupied cells are stored, in an open
+    // addressing table, so sparse maps spread over a large area stay cheap.
+    double total_len = 0;
+    for (int i = 0; i < num_segments_; i++) {
+      const Point &a = pts[i];
+      const Point &b = pts[(i + 1) % n];
+      total_len += sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+    }
+    cell_ = (num_segments_ > 0 && total_len > 0)
+                ? 2.0 * total_len / num_segments_
+                : 1.0;
+    inv_cell_ = 1.0 / cell_;
+    gx_max_ = int((max_x - min_x_) * inv_cell_);
+    gy_max_ = int((max_y - min_y_) * inv_cell_);
+
+    // Collect (cell, segment) pairs, sort them by cell and pack each cell's
+    // segments, endpoints included, into one contiguous run of cell_items_.
+    std::vector<std::pair<long long, int> > pairs;
+    for (int i = 0; i < num_segments_; i++) {
+      const Point &a = pts[i];
+      const Point &b = pts[(i + 1) % n];
+      int cx0 = cellX(std::min(a.x, b.x)), cx1 = cellX(std::max(a.x, b.x));
+      int cy0 = cellY(std::min(a.y, b.y)), cy1 = cellY(std::max(a.y, b.y));
+      for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+          pairs.push_back(std::make_pair(cellKey(cx, cy), i));
+        }
+      }
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    int occupied = 0;
+    for (size_t k = 0; k < pairs.size(); k++) {
+      if (k == 0 || pairs[k].first != pairs[k - 1].first) occupied++;
+    }
+    int table_size = 16;
+    while (table_size < 2 * occupied) table_size *= 2;
+    table_mask_ = table_size - 1;
+    Cell empty = {0, 0, -1, -1};
+    std::vector<Cell> table(table_size, empty);
+    std::vector<Segment> items(pairs.size());
+    for (size_t k = 0; k < pairs.size(); k++) {
+      Segment &seg = items[k];
+      seg.i = pairs[k].second;
+      seg.j = (seg.i + 1) % n;
+      seg.ax = pts[seg.i].x;
+      seg.ay = pts[seg.i].y;
+      seg.bx = pts[seg.j].x;
+      seg.by = pts[seg.j].y;
+      if (k > 0 && pairs[k].first == pairs[k - 1].first) {
+        continue;
+      }
+      size_t end = k + 1;
+      while (end < pairs.size() && pairs[end].first == pairs[k].first) end++;
+      int cx = int(pairs[k].first >> 32), cy = int(pairs[k].first & 0xffffffff);
+      unsigned h = hashCell(cx, cy);
+      while (table[h].begin >= 0) h = (h + 1) & table_mask_;
+      table[h].cx = cx;
+      table[h].cy = cy;
+      table[h].begin = k;
+      table[h].end = end;
+    }
+    pts_.assign(pts);
+    table_.assign(table);
+    cell_items_.assign(items);
+  }
+
+  int size() const { return pts_.size(); }
+  double cellSize() const { return cell_; }
+
+  // Index of the waypoint closest to (x,y). Same result as
+  // ClosestWaypoint() in helpers.h, ties going to the lower index.
+  int closest(double x, double y) const {
+    Query q(this, x, y);
+    q.run(false);
+    return q.best_;
+  }
+
+  // Index i of the segment (waypoint i -> i+1) closest to (x,y).
+  int closestSegment(double x, double y) const {
+    Query q(this, x, y);
+    q.run(true);
+    return q.best_;
+  }
+
+  // Table entries, plain aggregates so that map files can store them.
+  struct Point {
+    double x, y;
+  };
+
+  // Copy of a segment's endpoints, stored once per cell it touches.
+  struct Segment {
+    double ax, ay, bx, by;
+    int i, j;
+  };
+
+  // Slot in table_ for one occupied cell; begin < 0 marks an empty slot.
+  struct Cell {
+    int cx, cy, begin, end;
+  };
+
+ private:
+
+  // Cell coordinates relative to the map's lower left corner, clamped to
+  // the map's bounding box.
+  int cellX(double x) const {
+    return std::max(0, std::min(gx_max_, int((x - min_x_) * inv_cell_)));
+  }
+  int cellY(double y) const {
+    return std::max(0, std::min(gy_max_, int((y - min_y_) * inv_cell_)));
+  }
+  static long long cellKey(int cx, int cy) {
+    return ((long long)cx << 32) | (unsigned)cy;
+  }
+  unsigned hashCell(int cx, int cy) const {
+    return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & table_mask_;
+  }
+  // Linear probing up to the first empty slot, and never more than once
+  // around the table, so that a full table (e.g. from a corrupt map file)
+  // cannot loop forever.
+  const Cell *findCell(int cx, int cy) const {
+    unsigned h = hashCell(cx, cy);
+    for (unsigned probes = 0; probes <= table_mask_ && table_[h].begin >= 0; probes++) {
+      if (table_[h].cx == cx && table_[h].cy == cy) return &table_[h];
+      h = (h + 1) & table_mask_;
+    }
+    return 0;
+  }
+
+  // Ring search state for a single query.
+  struct Query {
+    const WaypointIndex *idx_;
+    double x_, y_;
+    int best_;
+    double best_d2_;
+
+    Query(const WaypointIndex *idx, double x, double y)
+        : idx_(idx), x_(x), y_(y), best_(0), best_d2_(HUGE_VAL) {}
+
+    void consider(int i, double d2) {
+      if (d2 < best_d2_ || (d2 == best_d2_ && i < best_)) {
+        best_d2_ = d2;
+        best_ = i;
+      }
+    }
+
+    void visitCell(int cx, int cy, bool segments) {
+      const WaypointIndex &w = *idx_;
+      const Cell *c = w.findCell(cx, cy);
+      if (!c) return;
+      for (int k = c->begin; k < c->end; k++) {
+        const Segment &seg = w.cell_items_[k];
+        if (segments) {
+          double ux = seg.bx - seg.ax, uy = seg.by - seg.ay;
+          double px = x_ - seg.ax, py = y_ - seg.ay;
+          double uu = ux * ux + uy * uy;
+          double t = (uu > 0) ? (px * ux + py * uy) / uu : 0.0;
+          t = std::max(0.0, std::min(1.0, t));
+          double ex = px - t * ux, ey = py - t * uy;
+          consider(seg.i, ex * ex + ey * ey);
+        } else {
+          double ax = x_ - seg.ax, ay = y_ - seg.ay;
+          double bx = x_ - seg.bx, by = y_ - seg.by;
+          consider(seg.i, ax * ax + ay * ay);
+          consider(seg.j, bx * bx + by * by);
+        }
+      }
+    }
+
+    void bruteForce(bool segments) {
+      const WaypointIndex &w = *idx_;
+      int n = w.pts_.size();
+      for (int i = 0; i < n; i++) {
+        double dx = x_ - w.pts_[i].x, dy = y_ - w.pts_[i].y;
+        if (segments && i < w.num_segments_) {
+          const Point &b = w.pts_[(i + 1) % n];
+          double ux = b.x - w.pts_[i].x, uy = b.y - w.pts_[i].y;
+          double uu = ux * ux + uy * uy;
+          double t = (uu > 0) ? (dx * ux + dy * uy) / uu : 0.0;
+          t = std::max(0.0, std::min(1.0, t));
+          dx -= t * ux;
+          dy -= t * uy;
+        } else if (segments) {
+          continue;
+        }
+        consider(i, dx * dx + dy * dy);
+      }
+    }
+
+    void run(bool segments) {
+      const WaypointIndex &w = *idx_;
+      if (w.num_segments_ == 0) {
+        bruteForce(false);
+        return;
+      }
+      int cx = w.cellX(x_), cy = w.cellY(y_);
+      for (int r = 0;; r++) {
+        // Points far off the map would walk a lot of empty rings first.
+        if (r > kMaxRings) {
+          bruteForce(segments);
+          return;
+        }
+        int x0 = cx - r, x1 = cx + r, y0 = cy - r, y1 = cy + r;
+        for (int ry = std::max(y0, 0); ry <= std::min(y1, w.gy_max_); ry++) {
+          bool edge_row = (ry == y0 || ry == y1);
+          for (int rx = std::max(x0, 0); rx <= std::min(x1, w.gx_max_);
+               rx += (edge_row || rx == x1) ? 1 : (x1 - rx)) {
+            visitCell(rx, ry, segments);
+          }
+        }
+
+        // Lower bound on the distance to any cell outside the visited
+        // square: the nearest side that is not already the map's border.
+        double bound = HUGE_VAL;
+        if (x0 > 0) bound = std::min(bound, x_ - (w.min_x_ + x0 * w.cell_));
+        if (y0 > 0) bound = std::min(bound, y_ - (w.min_y_ + y0 * w.cell_));
+        if (x1 < w.gx_max_)
+          bound = std::min(bound, (w.min_x_ + (x1 + 1) * w.cell_) - x_);
+        if (y1 < w.gy_max_)
+          bound = std::min(bound, (w.min_y_ + (y1 + 1) * w.cell_) - y_);
+        if (bound == HUGE_VAL) return;  // whole map visited
+        if (bound > 0 && bound * bound > best_d2_) return;
+      }
+    }
+  };
+
+  static const int kMaxRings = 8;
+
+  friend class MapFile;  // reads and attaches the tables
+
+  MapArray<Point> pts_;
+  MapArray<Cell> table_;
+  MapArray<Segment> cell_items_;
+  unsigned table_mask_ = 0;
+  int num_segments_ = 0;
+  int gx_max_ = 0, gy_max_ = 0;
+  double min_x_ = 0, min_y_ = 0;
+  double cell_ = 1, inv_cell_ = 1;
+};
+
+#endif  // WAYPOINT_INDEX_H
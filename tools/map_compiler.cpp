@@ -0,0 +1,77 @@
+// Converts a waypoint CSV (x y s dx dy per line) into the binary map format
+// of map_file.h, or with --header into a C++ header embedding the same
+// tables as constexpr arrays, or with --tiles into the tiled map format of
+// tiled_road_map.h, cut into tiles L meters of s long.
+//
+//   map_compiler <map.csv> <map.bin> [--max-s S] [--header]
+//   map_compiler <map.csv> <map.tiles> --tiles L [--open] [--max-s S]
+//
+// Without --max-s, the map is taken to be a closed loop that wraps back to
+// s = 0 one segment after its last waypoint. --open makes a tiled map of a
+// route that ends at its last waypoint instead.
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include "map_file.h"
+#include "tiled_road_map.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+  string csv_file, bin_file;
+  double max_s = 0;
+  bool header = false;
+  double tile_length = 0;
+  bool open_route = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--max-s" && i + 1 < argc) {
+      max_s = atof(argv[++i]);
+    } else if (arg == "--header") {
+      header = true;
+    } else if (arg == "--tiles" && i + 1 < argc) {
+      tile_length = atof(argv[++i]);
+    } else if (arg == "--open") {
+      open_route = true;
+    } else if (csv_file.empty()) {
+      csv_file = arg;
+    } else if (bin_file.empty()) {
+      bin_file = arg;
+    } else {
+      csv_file.clear();
+      break;
+    }
+  }
+  if (csv_file.empty() || bin_file.empty()) {
+    cerr << "usage: " << argv[0] << " <map.csv> <map.bin> [--max-s S] [--header]" << endl
+         << "       " << argv[0] << " <map.csv> <map.tiles> --tiles L [--open] [--max-s S]"
+         << endl;
+    return 2;
+  }
+
+  MapWaypoints wp;
+  if (!readMapCsv(csv_file, &wp)) {
+    cerr << "No waypoints in " << csv_file << endl;
+    return 1;
+  }
+  if (max_s <= 0) {
+    max_s = open_route ? wp.s.back() : loopMaxS(wp);
+  }
+
+  string error;
+  bool written;
+  if (tile_length > 0) {
+    written = TiledRoadMap::write(bin_file, wp, max_s, tile_length, !open_route, &error);
+  } else if (header) {
+    written = MapFile::writeHeader(bin_file, wp, max_s, csv_file, &error);
+  } else {
+    written = MapFile::write(bin_file, wp, max_s, &error);
+  }
+  if (!written) {
+    cerr << error << endl;
+    return 1;
+  }
+  cout << "Wrote " << wp.size() << " waypoints, max_s = " << max_s << " to "
+       << bin_file << endl;
+  return 0;
+}
@@ -0,0 +1,251 @@
+// Replays capture files recorded with path_planning --record through the
+// planner, as fast as it runs, without a simulator or a socket.
+//
+//   planner_replay [--map file] [--spline-map] [--threads N] [--warmup N] [--check]
+//                  capture...
+//
+// Every received message goes through Planner::handle(), the code
+// path_planning runs on its event loop, with the same map options as the
+// recording. Reports frames per second, the per-stage latency percentiles
+// and the heap allocations per frame. With --check, every reply is compared
+// to the one recorded after the same message; the exit status is 1 if any
+// differs.
+//
+// Captures are split into shards at block boundaries, so that even a single
+// long session keeps every thread busy: with fewer files than threads, each
+// file is cut into about threads / files shards of whole blocks. A shard's
+// planner starts from a fresh state, so the shard first replays the
+// --warmup (default 250) messages before its first block unmeasured, which
+// brings the reference velocity up to speed as at the start of a session.
+// Its lane and speed can still differ from the recording's at that point,
+// so --check replays each file as a single shard from its first message.
+// A capture without an index (path_planning was killed before closing it)
+// is replayed up to its last whole block, with a warning; one without any
+// whole block is an error.
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "alloc_counter.h"
+#include "capture_file.h"
+#include "planner.h"
+
+using namespace std;
+
+struct Options {
+  string map_file = "../data/highway_map.csv";
+  bool use_spline_map = false;
+  bool check = false;
+  uint64_t warmup = 250;  // messages replayed before a shard's first block
+};
+
+// An open capture file, shared by its shards: CaptureReader::readBlock()
+// may run on several threads at once.
+struct Capture {
+  string path;
+  CaptureReader reader;
+};
+
+struct Shard {
+  const Capture *capture;
+  size_t first_block, end_block;  // the blocks measured
+  string error;
+  uint64_t messages = 0;
+  uint64_t frames = 0;       // telemetry messages answered with a path
+  uint64_t checked = 0;      // replies compared with the recording
+  uint64_t mismatches = 0;
+  long allocations = 0;      // in Planner::handle()
+  PlannerMetrics metrics;
+};
+
+static void replay(const Options &options, Shard *shard) {
+  PlannerMap map;
+  if (!map.load(options.map_file, options.use_spline_map, &shard->error)) return;
+  const CaptureReader &capture = shard->capture->reader;
+  AsyncLogger logger;
+  logger.setLevel(AsyncLogger::kOff);
+  // Room for the synthetic traffic of traffic_capture's sessions
+  Planner planner(&map, &logger, &shard->metrics, TelemetryFrame::kMaxSyntheticCars);
+
+  // Warm up from the block holding the message `warmup` messages before
+  // the shard, assuming each was followed by its reply
+  uint64_t first_record = capture.block(shard->first_block).first_record;
+  size_t b = shard->first_block;
+  if (b > 0) {
+    b = capture.blockOf(first_record - min<uint64_t>(first_record, 2 * options.warmup));
+  }
+  string raw, reply, expected;
+  vector<CaptureRecord> records;
+  bool pending = false;  // expected holds a reply not yet compared
+  for (; b < shard->end_block; b++) {
+    records.clear();
+    if (!capture.readBlock(b, &raw, &records, &shard->error)) {
+      shard->error = shard->capture->path + ": " + shard->error;
+      return;
+    }
+    if (b < shard->first_block) {
+      for (const CaptureRecord &r : records) {
+        if (r.kind == CaptureRecord::kReceived) {
+          planner.handle(r.data, r.length, shard->metrics.now(), &reply);
+        }
+      }
+      // Only the shard's own blocks are measured
+      if (b + 1 == shard->first_block) shard->metrics = PlannerMetrics();
+      continue;
+    }
+    for (const CaptureRecord &r : records) {
+      if (r.kind == CaptureRecord::kSent) {
+        if (options.check) {
+          shard->checked++;
+          if (!pending || expected.compare(0, string::npos, r.data, r.length) != 0) {
+            shard->mismatches++;
+          }
+        }
+        pending = false;
+        continue;
+      }
+      if (r.kind != CaptureRecord::kReceived) continue;
+      if (pending && options.check) {
+        // No reply was recorded
+        shard->checked++;
+        shard->mismatches++;
+      }
+      shard->messages++;
+      long before = heapAllocations();
+      uint64_t start = shard->metrics.now();
+      Planner::Reply kind = planner.handle(r.data, r.length, start, &reply);
+      if (kind == Planner::kControl) {
+        shard->metrics.lap(PlannerMetrics::kEndToEnd, start);
+        shard->frames++;
+      }
+      shard->allocations += heapAllocations() - before;
+      pending = (kind != Planner::kNoReply);
+      if (pending && options.check) expected = reply;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  int threads = max(1u, thread::hardware_concurrency());
+  vector<unique_ptr<Capture> > captures;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--map" && i + 1 < argc) {
+      options.map_file = argv[++i];
+    } else if (arg == "--spline-map") {
+      options.use_spline_map = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = max(1, atoi(argv[++i]));
+    } else if (arg == "--warmup" && i + 1 < argc) {
+      options.warmup = max(0, atoi(argv[++i]));
+    } else if (arg == "--check") {
+      options.check = true;
+    } else {
+      captures.push_back(unique_ptr<Capture>(new Capture));
+      captures.back()->path = arg;
+    }
+  }
+  if (captures.empty()) {
+    cerr << "usage: " << argv[0]
+         << " [--map file] [--spline-map] [--threads N] [--warmup N] [--check] capture..."
+         << endl;
+    return 2;
+  }
+
+  int opened = 0, failed = 0;
+  vector<unique_ptr<Shard> > shards;
+  int per_file = options.check ? 1 : (threads + captures.size() - 1) / captures.size();
+  for (const unique_ptr<Capture> &c : captures) {
+    string error;
+    if (!c->reader.open(c->path, &error)) {
+      cerr << error << endl;
+      failed++;
+      continue;
+    }
+    if (c->reader.indexRebuilt()) {
+      // The recording was not closed: replay the whole blocks, but say so,
+      // since the end of the session is missing
+      if (c->reader.numBlocks() == 0) {
+        cerr << c->path << ": no index and no whole block, the recording was not closed" << endl;
+        failed++;
+        continue;
+      }
+      cerr << c->path << ": no index, the recording was not closed; replaying "
+           << c->reader.numRecords() << " records from " << c->reader.numBlocks()
+           << " whole blocks, " << c->reader.lostBytes() << " bytes after them lost" << endl;
+    }
+    opened++;
+    // Whole blocks, as evenly as they go
+    size_t blocks = c->reader.numBlocks();
+    size_t n = min<size_t>(per_file, blocks);
+    for (size_t k = 0; k < n; k++) {
+      shards.push_back(unique_ptr<Shard>(new Shard));
+      shards.back()->capture = c.get();
+      shards.back()->first_block = blocks * k / n;
+      shards.back()->end_block = blocks * (k + 1) / n;
+    }
+  }
+  threads = max(1, min<int>(threads, shards.size()));
+
+  // Threads take the next shard until none are left.
+  atomic<size_t> next(0);
+  uint64_t t0 = PlannerMetrics::now();
+  vector<thread> workers;
+  for (int k = 0; k < threads; k++) {
+    workers.push_back(thread([&] {
+      for (size_t i; (i = next++) < shards.size();) replay(options, shards[i].get());
+    }));
+  }
+  for (thread &w : workers) w.join();
+  double seconds = (PlannerMetrics::now() - t0) * 1e-9;
+
+  PlannerMetrics total;
+  uint64_t messages = 0, frames = 0, checked = 0, mismatches = 0;
+  long allocs = 0;
+  for (const unique_ptr<Shard> &s : shards) {
+    if (!s->error.empty()) {
+      cerr << s->error << endl;
+      failed++;
+      continue;
+    }
+    total.merge(s->metrics);
+    messages += s->messages;
+    frames += s->frames;
+    checked += s->checked;
+    mismatches += s->mismatches;
+    allocs += s->allocations;
+  }
+
+  cout << opened << " captures in " << shards.size() << " shards, "
+       << messages << " messages, " << frames << " frames in " << seconds << " s on "
+       << threads << " threads: "
+       << frames / seconds << " frames/s" << endl;
+  cout << "  stage              p50 us    p99 us  p99.9 us    max us" << endl;
+  for (int i = 0; i < PlannerMetrics::kNumStages; i++) {
+    PlannerMetrics::Stage stage = PlannerMetrics::Stage(i);
+    const LatencyHistogram &h = total.stage(stage);
+    if (h.count() == 0) continue;
+    string name = PlannerMetrics::stageName(stage);
+    name.resize(16, ' ');
+    cout << "  " << name;
+    const double quantiles[] = {0.5, 0.99, 0.999};
+    for (double q : quantiles) {
+      cout.width(10);
+      cout << h.quantile(q) * 1e-3;
+    }
+    cout.width(10);
+    cout << h.max() * 1e-3 << endl;
+  }
+  cout << "  allocations/frame  " << (frames ? double(allocs) / frames : 0) << endl;
+  if (total.truncatedFrames() > 0) {
+    cout << "  truncated frames   " << total.truncatedFrames() << endl;
+  }
+  if (options.check) {
+    cout << "  replies matching   " << checked - mismatches << "/" << checked << endl;
+  }
+  return (failed > 0 || mismatches > 0) ? 1 : 0;
+}
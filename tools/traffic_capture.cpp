@@ -0,0 +1,196 @@
+// Writes a capture file of a simulated session in synthetic traffic, for
+// planner_replay, so that the planner can be run with far more cars than
+// the simulator provides.
+//
+//   traffic_capture [--map file] [--spline-map] [--seed N] [--cars N]
+//                   [--density cars/km] [--lanes L,C,R] [--speed m/s]
+//                   [--speed-spread m/s] [--clearance m] [--frames N]
+//                   [--points-per-frame N] [--start-s S] output.cap
+//
+// Stands in for the simulator: the traffic comes from TrafficGenerator
+// (src/traffic_generator.h), and the ego car is driven by Planner::handle()
+// itself, moving --points-per-frame points along the path of the previous
+// reply every frame, so the session is the planner's closed loop on the
+// given map. Each telemetry message and reply is recorded as with
+// path_planning --record, 20 ms per path point apart. The same options
+// give the same messages. A session ends early if the car slows to a stop
+// behind traffic, which the planner does not handle.
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "capture_file.h"
+#include "json.hpp"
+#include "map_file.h"
+#include "planner.h"
+#include "traffic_generator.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static bool parseLanes(const string &arg, array<double, TrafficGenerator::kLanes> *lanes) {
+  size_t pos = 0;
+  for (int i = 0; i < TrafficGenerator::kLanes; i++) {
+    size_t end = arg.find(',', pos);
+    if ((end == string::npos) != (i == TrafficGenerator::kLanes - 1)) return false;
+    (*lanes)[i] = atof(arg.substr(pos, end - pos).c_str());
+    pos = end + 1;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  string map_file = "../data/highway_map.csv", out_file;
+  bool use_spline_map = false;
+  TrafficGenerator::Options traffic;
+  // Room to get up to speed from the standstill the session starts in
+  traffic.clearance = 150;
+  int frames = 2000, points_per_frame = 3;
+  double start_s = 124.8;
+  bool ok = true;
+  for (int i = 1; i < argc && ok; i++) {
+    string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--map" && has_value) {
+      map_file = argv[++i];
+    } else if (arg == "--spline-map") {
+      use_spline_map = true;
+    } else if (arg == "--seed" && has_value) {
+      traffic.seed = strtoul(argv[++i], 0, 10);
+    } else if (arg == "--cars" && has_value) {
+      traffic.cars = max(0, atoi(argv[++i]));
+      // As many as the planner's frames hold
+      ok = traffic.cars <= TelemetryFrame::kMaxSyntheticCars;
+    } else if (arg == "--density" && has_value) {
+      traffic.density = atof(argv[++i]);
+    } else if (arg == "--lanes" && has_value) {
+      ok = parseLanes(argv[++i], &traffic.lane_weights);
+    } else if (arg == "--speed" && has_value) {
+      traffic.speed = atof(argv[++i]);
+    } else if (arg == "--speed-spread" && has_value) {
+      traffic.speed_spread = atof(argv[++i]);
+    } else if (arg == "--clearance" && has_value) {
+      traffic.clearance = atof(argv[++i]);
+    } else if (arg == "--frames" && has_value) {
+      frames = atoi(argv[++i]);
+    } else if (arg == "--points-per-frame" && has_value) {
+      points_per_frame = max(1, atoi(argv[++i]));
+    } else if (arg == "--start-s" && has_value) {
+      start_s = atof(argv[++i]);
+    } else if (out_file.empty() && arg[0] != '-') {
+      out_file = arg;
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok || out_file.empty()) {
+    cerr << "usage: " << argv[0]
+         << " [--map file] [--spline-map] [--seed N] [--cars N] [--density cars/km]"
+            " [--lanes L,C,R] [--speed m/s] [--speed-spread m/s] [--clearance m]"
+            " [--frames N] [--points-per-frame N] [--start-s S] output.cap"
+         << endl;
+    return 2;
+  }
+
+  // The planner's map, and the same road for placing the cars
+  string error;
+  PlannerMap map;
+  if (!map.load(map_file, use_spline_map, &error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  MapFile map_bin;
+  RoadMap csv_road;
+  const RoadMap *road = &csv_road;
+  if (TiledRoadMap::isTileFile(map_file)) {
+    cerr << "traffic_capture needs a CSV or binary map" << endl;
+    return 1;
+  } else if (MapFile::isMapFile(map_file)) {
+    if (!map_bin.open(map_file, &error)) {
+      cerr << error << endl;
+      return 1;
+    }
+    road = &map_bin.roadMap();
+  } else {
+    MapWaypoints wp;
+    readMapCsv(map_file, &wp);
+    // As PlannerMap loads a CSV map
+    csv_road.build(wp.x, wp.y, wp.s, wp.dx, wp.dy, 6945.554);
+  }
+
+  CaptureWriter capture;
+  if (!capture.open(out_file, &error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  AsyncLogger logger;
+  logger.setLevel(AsyncLogger::kOff);
+  PlannerMetrics metrics;
+  Planner planner(&map, &logger, &metrics, TelemetryFrame::kMaxSyntheticCars);
+  TrafficGenerator generator(road, traffic);
+  generator.reset(start_s);
+
+  // Standing still in the center lane, with no path yet, as the simulator
+  // starts.
+  EgoState ego = EgoState::cruising(*road, start_s, 6, 0, 0);
+  uint64_t t0 = capture::wallClockNs();
+  const uint64_t frame_ns = uint64_t(points_per_frame) * 20000000;
+  string message, reply;
+  int answered = 0, recorded = 0;
+  for (int k = 0; k < frames; k++, recorded++) {
+    uint64_t time = t0 + k * frame_ns;
+    telemetryMessage(ego, generator.rows(), &message);
+    capture.append(CaptureRecord::kReceived, time, message.data(), message.size());
+    if (planner.handle(message.data(), message.size(), metrics.now(), &reply) !=
+        Planner::kControl) {
+      continue;
+    }
+    capture.append(CaptureRecord::kSent, time, reply.data(), reply.size());
+    answered++;
+    // Slowed to a stop behind a car: the planner's paths at zero or less
+    // speed stand still or run backwards, and the next spline fit on them
+    // fails, so the session ends with this frame
+    if (planner.refVel() <= 0) {
+      cerr << "the car came to a stop behind traffic in frame " << k
+           << "; the planner does not move off from a standstill, so the capture ends there"
+           << endl;
+      recorded++;
+      break;
+    }
+
+    // The simulator drives along the new path and reports what is left
+    json control = json::parse(reply.begin() + 2, reply.end())[1];
+    vector<double> path_x = control["next_x"], path_y = control["next_y"];
+    int moved = min<int>(points_per_frame, path_x.size());
+    if (moved > 0) {
+      double last_x = moved > 1 ? path_x[moved - 2] : ego.x;
+      double last_y = moved > 1 ? path_y[moved - 2] : ego.y;
+      double x = path_x[moved - 1], y = path_y[moved - 1];
+      if (x != last_x || y != last_y) ego.yaw = rad2deg(atan2(y - last_y, x - last_x));
+      ego.speed = distance(last_x, last_y, x, y) / 0.02 * 2.24;
+      ego.x = x;
+      ego.y = y;
+    }
+    array<double, 2> sd = road->getFrenet(ego.x, ego.y);
+    ego.s = sd[0];
+    ego.d = sd[1];
+    ego.previous_path_x.assign(path_x.begin() + moved, path_x.end());
+    ego.previous_path_y.assign(path_y.begin() + moved, path_y.end());
+    if (!ego.previous_path_x.empty()) {
+      sd = road->getFrenet(ego.previous_path_x.back(), ego.previous_path_y.back());
+    }
+    ego.end_path_s = sd[0];
+    ego.end_path_d = sd[1];
+    generator.step(moved * 0.02);
+  }
+  if (!capture.close(&error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  cout << out_file << ": " << recorded << " frames with " << traffic.cars << " cars, "
+       << answered << " replies; ended in lane " << planner.lane() << " at "
+       << planner.refVel() << " mph, s = " << ego.s << endl;
+  return 0;
+}